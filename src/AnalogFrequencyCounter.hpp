@@ -1,108 +1,221 @@
+#pragma once
+
+#include <atomic>
 #include <modm/platform.hpp>
 #include <modm/board.hpp>
 
-using Adc = modm::platform::Adc1;
-
-// Size of buffer to collect samples from ISR
-static const uint32_t SampleBufferSize = 256;
-// Fixed point scale for calculations 
-// sampleScale * meanScale must be < 2**20
-static constexpr uint32_t SampleScale = 16;
-// Fixed point scale for filter coefficients
-static constexpr uint32_t MeanScale = 32768;
-// Number of periods in moving average
-static const uint32_t NumPeriods = 6;
-// Filter coefficient for IIR mean filter
-static constexpr uint32_t MeanFilterAlpha = (0.001 * MeanScale);
-// ADC sampling period
-static const uint32_t SamplePeriodUs = 1000;
-// Hysteresis threshold. Input must reach `runningMean +/- MinSpread` to trigger a 
-// transition
-static const uint8_t MinSpread = 250;
-// If no edges are measured in this time, output goes to zero
-static const uint32_t TimeoutMs = 1000;
-
-static uint16_t sampleBuffer[SampleBufferSize];
-static uint32_t sampleHead;
-static uint32_t sampleTail;
-static uint32_t samplesSinceLastEdge = 0;
-static uint32_t runningMean = 2048 * SampleScale;
-static bool lastState = false;
-static uint32_t periods[NumPeriods] = {0};
-static uint32_t periodInPtr = 0;
-static float periodInSeconds = 0.0f;
-
-MODM_ISR(ADC1_2) {
-    Adc::acknowledgeInterruptFlag(Adc::getInterruptFlags());
-
-    uint16_t sample = Adc::getValue();
-    // Convert 12-bit sample to 8 bit
-    sampleBuffer[sampleHead] = (sample);
-    sampleHead = (sampleHead + 1) % SampleBufferSize;\
-}
+#include "Placement.hpp"
+#include "SpscRingBuffer.hpp"
+#include "TachDetector.hpp"
+#ifdef TACH_BLOCK_ESTIMATOR
+#include "BlockPeriodEstimator.hpp"
+#endif
 
+/** Configuration of the tach on the spindle: a reflective sensor on PA0, read
+ * by ADC1 at 1 kHz, with one pulse per revolution
+ *
+ * Derive from this to change some of it for another sensor, e.g.
+ *
+ *     struct ReferenceTachConfig : DefaultTachConfig {
+ *         using Adc = modm::platform::Adc2;
+ *         using Pin = GpioA1::In2;
+ *         static constexpr Adc::Channel Channel = Adc::Channel::Channel2;
+ *     };
+ *
+ * The edge detector tuning comes from TachDetectorConfig.
+ */
+struct DefaultTachConfig : TachDetectorConfig {
+    using Adc = modm::platform::Adc1;
+    // Pin signal, as passed to Adc::connect()
+    using Pin = GpioA0::In1;
+    static constexpr Adc::Channel Channel = Adc::Channel::Channel1;
+    // Size of buffer to collect samples from ISR. Must be a power of two.
+    static constexpr uint32_t SampleBufferSize = 256;
+};
+
+/** Start `Timer` interrupting every `periodUs`
+ *
+ * The application creates the timer ISR, acknowledges the interrupt, and calls
+ * startConversion() of every counter sampled at that rate.
+ */
 template<class Timer, class SystemClock>
+void startSampleTimer(uint32_t periodUs) {
+    Timer::enable();
+    Timer::template setPeriod<SystemClock>(periodUs);
+    Timer::setMode(
+        Timer::Mode::UpCounter,
+        Timer::SlaveMode::Disabled
+    );
+    // TODO: This works with basic timers. Advanced timers need a special
+    // special case here
+    Timer::enableInterruptVector(true, 4);
+    Timer::enableInterrupt(Timer::Interrupt::Update);
+    Timer::start();
+}
+
+/** Tach frequency measurement from analog samples of a reflective sensor
+ *
+ * Each instance has its own ADC, sample buffer and detector state, so several
+ * sensors can be measured at once. Everything in Config is a compile time
+ * constant, so the per-sample work is specialized for it. The edge detection
+ * itself is done by TachDetector.
+ */
+template<class Config>
 class AnalogFrequencyCounter {
 public:
-    static void initialize() {
-        Timer::enable();
-        Timer::template setPeriod < SystemClock >(SamplePeriodUs);
-        Timer::setMode(
-            Timer::Mode::UpCounter,
-            Timer::SlaveMode::Disabled
-        );
-        // TODO: This works with basic timers. Advanced timers need a special 
-        // special case here
-        Timer::enableInterruptVector(true, 4);
-        Timer::enableInterrupt(Timer::Interrupt::Update);
-        Timer::start();
+    using Adc = typename Config::Adc;
+    using Detector = TachDetector<Config>;
+    using Analytics = typename Detector::Analytics;
+
+    static constexpr uint32_t SamplePeriodUs = Config::SamplePeriodUs;
+
+    AnalogFrequencyCounter() :
+        sampleTap(nullptr),
+        replaying(false)
+    {
+
+    }
 
+    /** Set up the ADC. Several counters may share its interrupt vector. */
+    void initialize() {
         Adc::initialize();
-        Adc::connect<GpioA0::In1>();
-        Adc::setChannel(Adc::Channel::Channel1, Adc::SampleTime::Cycles248);
+        Adc::template connect<typename Config::Pin>();
+        Adc::setChannel(Config::Channel, Adc::SampleTime::Cycles248);
         Adc::enableInterruptVector(4);
         Adc::enableInterrupt(Adc::Interrupt::EndOfRegularConversion);
     }
 
-    static void task() {
-        while(sampleTail != sampleHead) {
-            processSample(sampleBuffer[sampleTail]);
-            sampleTail = (sampleTail + 1) % SampleBufferSize;
+    // Application needs to create the sample timer ISR and call this
+    static inline void startConversion() {
+        Adc::startConversion();
+    }
+
+    // Application needs to create the ADC ISR and call this
+    HOT_CODE void adcHandler() {
+        // The vector may be shared with another ADC
+        if(!Adc::isConversionFinished()) {
+            return;
+        }
+        Adc::acknowledgeInterruptFlag(Adc::getInterruptFlags());
+        uint16_t sample = Adc::getValue();
+        // While replaying, pushSample() is the buffer's only producer. The
+        // conversions go on, and with a shared vector this handler still runs
+        // for the other ADC's interrupts, so the check can't rely on this
+        // ADC's interrupt being disabled.
+        if(replaying.load(std::memory_order_relaxed)) {
+            return;
         }
 
-        uint32_t periodAvg = 0;
-        for(uint32_t i=0; i<NumPeriods; i++) {
-            periodAvg += periods[i];
+        // If the task falls behind, the sample is dropped and counted as an overrun
+        sampleBuffer.push(sample);
+    }
+
+    HOT_CODE void task() {
+        uint16_t block[32];
+        uint32_t count;
+        while((count = sampleBuffer.pop(block)) > 0) {
+            if(sampleTap) {
+                sampleTap(block, count);
+            }
+            for(uint32_t i = 0; i < count; i++) {
+                processSample(block[i]);
+#ifdef TACH_BLOCK_ESTIMATOR
+                blockEstimator.push(block[i]);
+#endif
+            }
         }
-        periodInSeconds = (float)periodAvg / NumPeriods * (float)SamplePeriodUs / 1e6;
+
+        detector.update();
     }
 
-    // Application needs to create ISR and call this handler
-    static inline void isrHandler() {
-        Timer::acknowledgeInterruptFlags(Timer::getInterruptFlags());
-        Adc::startConversion();
+    /** Run one sample through the edge detector, bypassing the buffer */
+    HOT_CODE inline void processSample(uint16_t rawSample) {
+        detector.processSample(rawSample);
     }
 
-    static inline void processSample(uint16_t sample) {
-        sample *= SampleScale;
-        runningMean = (runningMean * (MeanScale - MeanFilterAlpha) + sample * MeanFilterAlpha + MeanScale / 2) / MeanScale;
-        samplesSinceLastEdge++;
-        if(!lastState && sample > runningMean + MinSpread * SampleScale) {
-            lastState = true;
-            periods[periodInPtr] = samplesSinceLastEdge;
-            periodInPtr = (periodInPtr + 1) % NumPeriods;
-            samplesSinceLastEdge = 0;
-        } else if (lastState && sample < runningMean - MinSpread * SampleScale) {
-            lastState = false;
-        }
+    /** Queue a sample as if it came from the ADC ISR
+     *
+     * For feeding recorded or generated samples, e.g. in benchmarks. Must not
+     * be used while the ADC interrupt is running, as the buffer has a single
+     * producer.
+     */
+    bool pushSample(uint16_t sample) {
+        return sampleBuffer.push(sample);
+    }
+
+    /** Pass every raw sample to `tap` as well, or nothing if it is nullptr */
+    void setSampleTap(void (*tap)(const uint16_t *samples, uint32_t count)) {
+        sampleTap = tap;
     }
 
-    static float getFrequency() {
-        static constexpr uint32_t timeoutSamples = TimeoutMs * 1000 / SamplePeriodUs;
-        if(periodInSeconds > 0.0 && samplesSinceLastEdge < timeoutSamples) {
-            return 1.0f / periodInSeconds;
+    /** Stop taking ADC samples, so that recorded ones can be fed in with
+     * pushSample(), or go back to the ADC
+     *
+     * Starting a replay, also while one is running, first processes the
+     * samples already queued, and then starts the detector over as after a
+     * signal loss, so that what follows is measured on its own. Must be
+     * called from the same context as task().
+     */
+    void setReplay(bool replay) {
+        if(replay) {
+            replaying.store(true, std::memory_order_relaxed);
+            Adc::disableInterrupt(Adc::Interrupt::EndOfRegularConversion);
+            task();
+            detector.reacquire();
         } else {
-            return 0.0f;
+            Adc::enableInterrupt(Adc::Interrupt::EndOfRegularConversion);
+            replaying.store(false, std::memory_order_relaxed);
         }
     }
+
+    /** Number of ADC samples dropped because task() did not keep up */
+    uint32_t getOverruns() const {
+        return sampleBuffer.getOverruns();
+    }
+
+    /** Most samples ever waiting in the buffer for task() */
+    uint32_t getBufferHighWater() const {
+        return sampleBuffer.getHighWater();
+    }
+
+    /** Time since the last edge, as of the last sample processed by task() */
+    uint32_t getMsSinceLastEdge() const {
+        return detector.getMsSinceLastEdge();
+    }
+
+    /** Average revolution period over the last few edges, or 0 if there is none */
+    uint32_t getPeriodMs() const {
+        return detector.getPeriodMs();
+    }
+
+    /** Period jitter statistics over the last block of pulses */
+    const Analytics& getPeriodAnalytics() const {
+        return detector.getPeriodAnalytics();
+    }
+
+    /** Revolutions per second */
+    float getFrequency() const {
+#ifdef TACH_BLOCK_ESTIMATOR
+        float blockPeriod = blockEstimator.getPeriod();
+        if(blockPeriod > 0.0f) {
+            return 1e6f / (blockPeriod * SamplePeriodUs * Config::PulsesPerRev);
+        }
+        return 0.0f;
+#else
+        return detector.getFrequency();
+#endif
+    }
+
+private:
+    SpscRingBuffer<uint16_t, Config::SampleBufferSize> sampleBuffer;
+    Detector detector;
+#ifdef TACH_BLOCK_ESTIMATOR
+    // 512 ms window, updated every 128 ms, for periods of 4 to 240 samples,
+    // i.e. 250 to 15000 RPM at the 1 kHz sample rate
+    BlockPeriodEstimator<512, 128, 4, 240> blockEstimator;
+#endif
+    // Called with every block of raw samples taken by task(), e.g. for capture
+    void (*sampleTap)(const uint16_t *samples, uint32_t count);
+    // Set while recorded samples are fed in; the ADC handler then drops its own
+    std::atomic<bool> replaying;
 };
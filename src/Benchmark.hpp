@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stdint.h>
+#include <modm/platform.hpp>
+#include <modm/io.hpp>
+
+namespace bench {
+
+/** Cycle accurate timing using the DWT cycle counter */
+class CycleCounter {
+public:
+    static void enable() {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+    static inline uint32_t now() {
+        return DWT->CYCCNT;
+    }
+};
+
+struct Result {
+    const char *name;
+    uint32_t iterations;
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint32_t meanCycles;
+};
+
+struct FrameResult {
+    const char *name;
+    uint32_t drawCalls;
+    uint32_t pixels;
+    uint32_t bytes;
+    uint32_t hash;
+    uint32_t cycles;
+};
+
+/** Runs benchmark cases and writes the results as one JSON document
+ *
+ * Each case is a callable taking the iteration number, which it should use to
+ * pick its input from pre-generated data, so that input generation isn't part
+ * of the measurement. Every call is timed on its own, and the cost of reading
+ * the cycle counter is subtracted.
+ *
+ * Output looks like:
+ *
+ *   {"benchmarks": [
+ *   {"name": "...", "iterations": 1000, "min": 10, "mean": 12, "max": 40},
+ *   ...
+ *   ]}
+ *
+ * where all times are in core cycles per call.
+ *
+ * UI frames are reported in the same list, with what they would send to the
+ * display instead of a timing distribution:
+ *
+ *   {"name": "frame:...", "draw_calls": 2, "pixels": 8960, "bytes": 17942,
+ *    "hash": 123456789, "cycles": 150000}
+ *
+ * and the RAM taken by an object as:
+ *
+ *   {"name": "ram:...", "bytes": 52}
+ */
+class Runner {
+public:
+    Runner(modm::IOStream &_out) :
+        out(_out),
+        count(0),
+        overhead(0)
+    {
+        CycleCounter::enable();
+        // Calibrate the cost of an empty measurement
+        uint32_t best = UINT32_MAX;
+        for(uint32_t i = 0; i < 16; i++) {
+            uint32_t start = CycleCounter::now();
+            asm volatile("" ::: "memory");
+            uint32_t cycles = CycleCounter::now() - start;
+            if(cycles < best) {
+                best = cycles;
+            }
+        }
+        overhead = best;
+        out << "{\"benchmarks\": [" << modm::endl;
+    }
+
+    template<typename Fn>
+    Result run(const char *name, uint32_t iterations, Fn &&fn) {
+        return run(name, iterations, [](uint32_t) {}, fn);
+    }
+
+    /** Run a case with an untimed setup step before each call */
+    template<typename Setup, typename Fn>
+    Result run(const char *name, uint32_t iterations, Setup &&setup, Fn &&fn) {
+        Result r = {name, iterations, UINT32_MAX, 0, 0};
+        uint64_t total = 0;
+        // Warm up caches and any lazily initialized state
+        setup(0);
+        fn(0);
+        for(uint32_t i = 0; i < iterations; i++) {
+            setup(i);
+            uint32_t start = CycleCounter::now();
+            fn(i);
+            asm volatile("" ::: "memory");
+            uint32_t cycles = CycleCounter::now() - start;
+            cycles = cycles > overhead ? cycles - overhead : 0;
+            total += cycles;
+            if(cycles < r.minCycles) {
+                r.minCycles = cycles;
+            }
+            if(cycles > r.maxCycles) {
+                r.maxCycles = cycles;
+            }
+        }
+        r.meanCycles = (uint32_t)(total / iterations);
+        report(r);
+        return r;
+    }
+
+    /** Render one UI frame into a counting canvas and report what it sent
+     *
+     * `fn` makes a UI change and flushes it to `canvas`. The cycle count covers
+     * composing the frame in RAM, but not the SPI transfer. The reported hash
+     * is of the screen after the frame.
+     */
+    template<typename Canvas, typename Fn>
+    FrameResult frame(const char *name, Canvas &canvas, Fn &&fn) {
+        canvas.reset();
+        uint32_t start = CycleCounter::now();
+        fn();
+        uint32_t cycles = CycleCounter::now() - start;
+        canvas.hashScreen();
+        FrameResult r = {
+            name,
+            canvas.getDrawCalls(),
+            canvas.getPixels(),
+            canvas.getBytes(),
+            canvas.getHash(),
+            cycles > overhead ? cycles - overhead : 0
+        };
+        report(r);
+        return r;
+    }
+
+    /** Report the RAM taken by an object, e.g. `sizeof` of a UI page */
+    void memory(const char *name, uint32_t bytes) {
+        if(count++ > 0) {
+            out << "," << modm::endl;
+        }
+        out << "{\"name\": \"ram:" << name << "\", \"bytes\": " << bytes << "}";
+    }
+
+    void finish() {
+        out << modm::endl << "]}" << modm::endl;
+    }
+
+private:
+    void report(const Result &r) {
+        if(count++ > 0) {
+            out << "," << modm::endl;
+        }
+        out << "{\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+            << ", \"min\": " << r.minCycles << ", \"mean\": " << r.meanCycles
+            << ", \"max\": " << r.maxCycles << "}";
+    }
+
+    void report(const FrameResult &r) {
+        if(count++ > 0) {
+            out << "," << modm::endl;
+        }
+        out << "{\"name\": \"frame:" << r.name << "\", \"draw_calls\": " << r.drawCalls
+            << ", \"pixels\": " << r.pixels << ", \"bytes\": " << r.bytes
+            << ", \"hash\": " << r.hash << ", \"cycles\": " << r.cycles << "}";
+    }
+
+    modm::IOStream &out;
+    uint32_t count;
+    uint32_t overhead;
+};
+
+} // namespace bench
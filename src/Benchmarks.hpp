@@ -0,0 +1,200 @@
+#pragma once
+
+#include <stdint.h>
+#include <modm/io.hpp>
+#include <modm/ui/display/graphic_display.hpp>
+
+#include "Benchmark.hpp"
+#include "BlockPeriodEstimator.hpp"
+#include "MotorControl.hpp"
+#include "MovingAverage.hpp"
+#include "PeriodAnalytics.hpp"
+#include "Stspin.hpp"
+#include "ui/CountingCanvas.hpp"
+#include "ui/StaticLayout.hpp"
+#include "ui/images/play.hpp"
+
+namespace bench {
+
+/** Small deterministic generator for benchmark inputs */
+class Lcg {
+public:
+    Lcg(uint32_t seed) : state(seed) {}
+
+    uint32_t next() {
+        state = state * 1664525 + 1013904223;
+        return state >> 8;
+    }
+
+    // Roughly gaussian noise with the given amplitude, from a sum of uniforms
+    int32_t noise(int32_t amplitude) {
+        int32_t sum = 0;
+        for(uint32_t i = 0; i < 4; i++) {
+            sum += (int32_t)(next() % 1024) - 512;
+        }
+        return sum * amplitude / 1024;
+    }
+
+private:
+    uint32_t state;
+};
+
+static const uint32_t NumTachSamples = 2048;
+
+// Clicks taken by the benchmark screen's button
+inline uint32_t clicks = 0;
+
+inline void onBenchClick() {
+    clicks++;
+}
+
+// A numeric and a button, laid out as on the main page
+using BenchNumeric = ui::NumericElement<20, 30, 4, 0x0000>;
+using BenchButton = ui::ImageButtonElement<210, 140, images::play, 10, onBenchClick>;
+
+/** Tach waveform: reflective tape pulse at `rpm`, on top of noise */
+inline void generateTach(uint16_t *out, uint32_t count, uint32_t rpm, Lcg &rng) {
+    // Period in 1 kHz samples
+    uint32_t period = 60000 / rpm;
+    for(uint32_t i = 0; i < count; i++) {
+        int32_t v = 1500 + rng.noise(40);
+        if(i % period < period * 3 / 10) {
+            v += 600;
+        }
+        out[i] = (uint16_t)v;
+    }
+}
+
+/** Run all benchmark cases through `runner`
+ *
+ * Draws on the display, so this must run before the UI is built, and the
+ * screen should be cleared afterwards.
+ */
+template<class FreqCounter, class Touch>
+void runBenchmarks(Runner &runner, modm::GraphicDisplay *display) {
+    Lcg rng(12345);
+
+    static uint16_t tach[NumTachSamples];
+    generateTach(tach, NumTachSamples, 3000, rng);
+
+    // An instance of its own, so the application's tach isn't disturbed
+    static FreqCounter counter;
+    runner.run("AnalogFrequencyCounter::processSample", NumTachSamples, [](uint32_t i) {
+        counter.processSample(tach[i]);
+    });
+
+    // One task() call drains the 10 ms worth of samples queued between runs
+    runner.run("AnalogFrequencyCounter::task", 100,
+        [](uint32_t i) {
+            for(uint32_t j = 0; j < 10; j++) {
+                counter.pushSample(tach[(i * 10 + j) % NumTachSamples]);
+            }
+        },
+        [](uint32_t) {
+            counter.task();
+        }
+    );
+
+    static BlockPeriodEstimator<512, 128, 4, 240> estimator;
+    runner.run("BlockPeriodEstimator::push", NumTachSamples, [](uint32_t i) {
+        estimator.push(tach[i]);
+    });
+
+    static int16_t signal[512];
+    for(uint32_t i = 0; i < 512; i++) {
+        signal[i] = (int16_t)(tach[i] - 1500);
+    }
+    runner.run("BlockPeriodEstimator::correlate(256)", 100, [](uint32_t i) {
+        volatile int32_t r = BlockPeriodEstimator<512, 128, 4, 240>::correlate(signal, signal + (i % 64), 256);
+        (void)r;
+    });
+
+    static uint32_t periods[256];
+    for(auto &p : periods) {
+        p = 20 + rng.noise(2);
+    }
+    // Runs over the end of a block, so the mean includes publishing a result
+    static float periodsUs[256];
+    for(auto &p : periodsUs) {
+        p = 20000.0f + rng.noise(200);
+    }
+    static PeriodAnalytics<64, 3> analytics({15, 60, 5, 1000});
+    runner.run("PeriodAnalytics::push", 256, [](uint32_t i) {
+        analytics.push(periodsUs[i]);
+    });
+
+    static MovingAverage<20> average;
+    runner.run("MovingAverage::push", 256, [](uint32_t i) {
+        average.push(periods[i]);
+    });
+    runner.run("MovingAverage::get", 256, [](uint32_t) {
+        volatile uint32_t r = average.get();
+        (void)r;
+    });
+
+    // Measured speed following a step from 0 to 1000 RPM
+    static float rpms[256];
+    for(uint32_t i = 0; i < 256; i++) {
+        rpms[i] = (i < 128 ? i * 8.0f : 1000.0f) + rng.noise(20);
+    }
+    static MotorControl control;
+    control.set_speed(1000);
+    runner.run("MotorControl::update", 256, [](uint32_t i) {
+        volatile float r = control.update(rpms[i]);
+        (void)r;
+    });
+
+    static uint16_t touchSamples[256][3];
+    for(auto &t : touchSamples) {
+        uint16_t base = 400 + rng.next() % 3400;
+        for(auto &v : t) {
+            v = base + rng.noise(30);
+        }
+    }
+    runner.run("Xpt2046::getBestTwo", 256, [](uint32_t i) {
+        volatile uint16_t r = Touch::getBestTwo(touchSamples[i]);
+        (void)r;
+    });
+
+    static uint8_t commandBuf[stspin::FrameSize];
+    runner.run("stspin::encodeRpmCommand", 256, [](uint32_t i) {
+        stspin::encodeRpmCommand(commandBuf, 1, 500 + i * 20, 7);
+    });
+
+    // UI cases, on a screen of their own. Drawing goes to a counting canvas,
+    // so it covers composing the bands in RAM, but not the SPI transfer.
+    static ui::StaticScreen<BenchNumeric, BenchButton> screen;
+    static ui::CountingCanvas<160 * 16> canvas(display);
+    screen.flush(canvas);
+    static uint16_t values[64];
+    for(auto &v : values) {
+        v = 900 + rng.next() % 200;
+    }
+    runner.run("NumericElement::setValue", 64, [](uint32_t i) {
+        screen.get<BenchNumeric>().setValue(values[i]);
+    });
+    screen.flush(canvas);
+    runner.run("StaticScreen::flush(numeric)", 64,
+        [](uint32_t i) {
+            // Differs from the last value, so something is drawn
+            screen.get<BenchNumeric>().setValue(values[i] ^ 0x100);
+        },
+        [](uint32_t) {
+            screen.flush(canvas);
+        }
+    );
+
+    static int16_t touchX[64], touchY[64];
+    static bool touchActive[64];
+    for(uint32_t i = 0; i < 64; i++) {
+        // Alternate presses and releases, half of the presses on the button
+        touchActive[i] = (i % 2) == 0;
+        touchX[i] = (i % 4 == 0) ? 230 : rng.next() % 320;
+        touchY[i] = (i % 4 == 0) ? 160 : rng.next() % 240;
+    }
+    runner.run("StaticScreen::handleTouchStatus", 64, [](uint32_t i) {
+        screen.handleTouchStatus(touchActive[i], touchX[i], touchY[i]);
+    });
+}
+
+} // namespace bench
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_FEATURE_DSP)
+#include <modm/platform.hpp>
+#endif
+
+/** Period estimator working on blocks of tach samples
+ *
+ * Alternative to the single threshold edge detector, for noisy signals where
+ * the detector chatters. Every `Hop` samples, the last `Window` samples are
+ * band-pass filtered (DC removal, followed by a short boxcar low-pass acting as
+ * a matched filter for a pulse), and the period is taken from the peak of their
+ * autocorrelation between `MinLag` and `MaxLag` samples, refined with a
+ * parabolic fit.
+ *
+ * The autocorrelation is the hot loop. On the M4 it uses the packed 16-bit
+ * SMLAD instruction to do two multiply-accumulates per cycle; other targets
+ * (e.g. the host) get the equivalent scalar loop.
+ *
+ * Samples are 12-bit ADC values. After DC removal they are halved, so that a
+ * full-scale product summed over the whole window cannot overflow 32 bits.
+ */
+template<uint32_t Window, uint32_t Hop, uint32_t MinLag, uint32_t MaxLag>
+class BlockPeriodEstimator {
+public:
+    static_assert(Window % 2 == 0, "Window must be even for packed processing");
+    static_assert(Window >= 2 * MaxLag + 2, "Window must hold at least two of the longest periods");
+    static_assert(MinLag >= 2 && MinLag < MaxLag, "Invalid lag range");
+    static_assert(Hop > 0 && Hop <= Window, "Invalid hop size");
+    static_assert((int64_t)2047 * 2047 * Window <= INT32_MAX, "Window too long for a 32-bit correlation");
+
+    // Minimum autocorrelation peak, relative to the zero lag energy, in 1/256,
+    // for an estimate to be accepted
+    static constexpr uint32_t MinConfidence = 64;
+    // Length of the boxcar low-pass filter. Its first null is at a period of
+    // SmoothTaps samples, so this keeps the shortest periods well clear of it.
+    static constexpr uint32_t SmoothTaps = MinLag / 2;
+
+    BlockPeriodEstimator() :
+        historyIn(0),
+        sinceUpdate(0),
+        filled(0),
+        confidence(0),
+        period(0.0f)
+    {
+
+    }
+
+    /** Add a sample
+     *
+     * @return true if a new estimate was computed
+     */
+    bool push(uint16_t sample) {
+        history[historyIn] = sample;
+        historyIn = (historyIn + 1) % Window;
+        if(filled < Window) {
+            filled++;
+        }
+        if(++sinceUpdate >= Hop && filled == Window) {
+            sinceUpdate = 0;
+            update();
+            return true;
+        }
+        return false;
+    }
+
+    /** Estimated period in samples, or 0 if there is no confident estimate */
+    float getPeriod() const {
+        return period;
+    }
+
+    /** Confidence of the last estimate, as correlation peak / energy in 1/256 */
+    uint32_t getConfidence() const {
+        return confidence;
+    }
+
+    /** Autocorrelation of two int16 sequences, packed two samples per word
+     *
+     * Public so that it can be benchmarked on its own.
+     */
+    static int32_t correlate(const int16_t *a, const int16_t *b, uint32_t length) {
+        int32_t acc = 0;
+        uint32_t i = 0;
+#if defined(__ARM_FEATURE_DSP)
+        for(; i + 2 <= length; i += 2) {
+            // Unaligned word loads are fine on the M4 for plain LDR
+            uint32_t pa, pb;
+            memcpy(&pa, a + i, sizeof(pa));
+            memcpy(&pb, b + i, sizeof(pb));
+            acc = __SMLAD(pa, pb, acc);
+        }
+#endif
+        for(; i < length; i++) {
+            acc += a[i] * b[i];
+        }
+        return acc;
+    }
+
+private:
+    void update() {
+        // Linearize the window, oldest sample first, and remove the mean
+        int32_t sum = 0;
+        for(uint32_t i = 0; i < Window; i++) {
+            sum += history[i];
+        }
+        int32_t mean = sum / (int32_t)Window;
+        for(uint32_t i = 0; i < Window; i++) {
+            work[i] = (int16_t)((history[(historyIn + i) % Window] - mean) / 2);
+        }
+
+        // Boxcar low-pass, in place. Output is delayed by SmoothTaps - 1, which
+        // doesn't matter for the period.
+        int32_t acc = 0;
+        int16_t delay[SmoothTaps] = {0};
+        for(uint32_t i = 0; i < Window; i++) {
+            acc += work[i] - delay[i % SmoothTaps];
+            delay[i % SmoothTaps] = work[i];
+            work[i] = (int16_t)(acc / (int32_t)SmoothTaps);
+        }
+
+        int32_t energy = correlate(work, work, Window);
+        if(energy <= 0) {
+            period = 0.0f;
+            confidence = 0;
+            return;
+        }
+
+        // Skip the main lobe around zero lag, i.e. until the correlation first
+        // goes negative. It is looked for from the first lag, as with a period
+        // close to MinLag, the correlation there is already the next peak.
+        uint32_t start = 1;
+        while(start < MaxLag && correlate(work, work + start, Window - start) > 0) {
+            start++;
+        }
+        if(start < MinLag) {
+            start = MinLag;
+        }
+
+        // One lag further than the longest period, so that a peak there can
+        // still be told from a slope
+        int32_t best = 0;
+        for(uint32_t lag = start; lag <= MaxLag + 1; lag++) {
+            corr[lag] = correlate(work, work + lag, Window - lag);
+            if(corr[lag] > best && lag <= MaxLag) {
+                best = corr[lag];
+            }
+        }
+
+        // Peaks at multiples of the period are nearly as high as the first one,
+        // and noise can make any of them the largest. Take the first peak which
+        // comes close to the global one: the highest point from where the
+        // correlation first gets to 3/4 of it until it falls below half of
+        // it. Looking at the whole peak rather than for the first local
+        // maximum keeps noise ripples on the way up from being taken for it.
+        uint32_t bestLag = 0;
+        uint32_t lag = start;
+        while(lag <= MaxLag && corr[lag] < best - best / 4) {
+            lag++;
+        }
+        for(; lag <= MaxLag && corr[lag] >= best / 2; lag++) {
+            if(bestLag == 0 || corr[lag] > corr[bestLag]) {
+                bestLag = lag;
+            }
+        }
+        // At either end of the range, the peak is outside of it
+        if(bestLag == start || corr[bestLag + 1] >= corr[bestLag]) {
+            bestLag = 0;
+        }
+
+        confidence = bestLag ? (uint32_t)((int64_t)corr[bestLag] * 256 / energy) : 0;
+        if(bestLag == 0 || confidence < MinConfidence) {
+            period = 0.0f;
+            return;
+        }
+
+        // Parabolic interpolation of the peak
+        float prev = corr[bestLag - 1];
+        float next = corr[bestLag + 1];
+        float denom = prev - 2.0f * corr[bestLag] + next;
+        float offset = 0.0f;
+        if(denom < 0.0f) {
+            offset = 0.5f * (prev - next) / denom;
+        }
+        period = (float)bestLag + offset;
+    }
+
+    uint16_t history[Window];
+    int16_t work[Window];
+    int32_t corr[MaxLag + 2];
+    uint32_t historyIn;
+    uint32_t sinceUpdate;
+    uint32_t filled;
+    uint32_t confidence;
+    float period;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <modm/platform.hpp>
+
+#include "DShotFrame.hpp"
+
+namespace dshot {
+
+/** DShot output on TIM1 channel 2 (PA9), with the bits fed by DMA
+ *
+ * The timer runs with one period per bit. On each update event, DMA1 channel
+ * 1 writes the compare value for the next bit into the preloaded CCR2, so a
+ * frame goes out with no CPU involvement once started. A frame takes 16 bit
+ * times, e.g. 27 us for DShot600.
+ *
+ * @tparam TimerClock TIM1 input clock in Hz
+ * @tparam Rate DShot rate in kbit/s: 150, 300 or 600
+ */
+template<uint32_t TimerClock, uint32_t Rate>
+class Tim1Ch2Output {
+public:
+    static_assert(Rate == 150 || Rate == 300 || Rate == 600, "DShot rate must be 150, 300 or 600");
+
+    static constexpr uint16_t BitTicks = TimerClock / (Rate * 1000);
+    // High time is 75% of the bit for a 1, and 37.5% for a 0
+    static constexpr uint16_t OneTicks = BitTicks * 3 / 4;
+    static constexpr uint16_t ZeroTicks = BitTicks * 3 / 8;
+
+    static_assert(BitTicks > 16 && BitTicks <= 0xffff, "Timer clock doesn't fit the DShot rate");
+
+    /** Set up the timer and DMA. The pin must already be connected to TIM1_CH2. */
+    static void initialize() {
+        RCC->APB2ENR |= RCC_APB2ENR_TIM1EN;
+        RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN | RCC_AHB1ENR_DMAMUX1EN;
+        __DSB();
+
+        TIM1->CR1 = 0;
+        TIM1->PSC = 0;
+        TIM1->ARR = BitTicks - 1;
+        TIM1->CCR2 = 0;
+        // PWM mode 1 with preload on channel 2
+        TIM1->CCMR1 = (TIM1->CCMR1 & ~(TIM_CCMR1_OC2M | TIM_CCMR1_CC2S)) |
+            (6 << TIM_CCMR1_OC2M_Pos) | TIM_CCMR1_OC2PE;
+        TIM1->CCER |= TIM_CCER_CC2E;
+        TIM1->BDTR |= TIM_BDTR_MOE;
+        TIM1->DIER |= TIM_DIER_UDE;
+        TIM1->EGR = TIM_EGR_UG;
+        TIM1->CR1 = TIM_CR1_ARPE | TIM_CR1_CEN;
+
+        // DMA1 channel 1 is routed through DMAMUX channel 0
+        DMAMUX1_Channel0->CCR = DmaRequestTim1Up;
+        DMA1_Channel1->CCR = 0;
+        DMA1_Channel1->CPAR = (uint32_t)&TIM1->CCR2;
+        DMA1_Channel1->CCR = DMA_CCR_DIR | DMA_CCR_MINC | DMA_CCR_PSIZE_0 | DMA_CCR_MSIZE_0 | DMA_CCR_PL;
+    }
+
+    /** Start sending a throttle frame
+     *
+     * @return false if the previous frame is still being sent
+     */
+    static bool send(uint16_t throttle, bool telemetry = false) {
+        if((DMA1_Channel1->CCR & DMA_CCR_EN) && DMA1_Channel1->CNDTR != 0) {
+            return false;
+        }
+        DMA1_Channel1->CCR &= ~DMA_CCR_EN;
+        DMA1->IFCR = DMA_IFCR_CGIF1;
+        fillBitBuffer(encodeFrame(throttle, telemetry), bits, OneTicks, ZeroTicks, IdleBits);
+        DMA1_Channel1->CMAR = (uint32_t)bits;
+        DMA1_Channel1->CNDTR = FrameBits + IdleBits;
+        DMA1_Channel1->CCR |= DMA_CCR_EN;
+        return true;
+    }
+
+private:
+    // DMAMUX request number of TIM1_UP (RM0440, DMAMUX request table)
+    static const uint32_t DmaRequestTim1Up = 46;
+    // Trailing low bits after the frame
+    static const uint32_t IdleBits = 2;
+
+    static inline uint16_t bits[FrameBits + IdleBits];
+};
+
+} // namespace dshot
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+// DShot frame encoding, kept apart from the output hardware in DShot.hpp so
+// that it builds on the host for the tests
+
+namespace dshot {
+
+// Bits per frame: 11 throttle bits, telemetry request, 4 bit checksum
+static const uint32_t FrameBits = 16;
+// Throttle values below this are special commands; 0 is motor stop
+static const uint16_t MinThrottle = 48;
+static const uint16_t MaxThrottle = 2047;
+
+/** Encode a DShot frame, most significant bit first on the wire */
+inline uint16_t encodeFrame(uint16_t throttle, bool telemetry = false) {
+    uint16_t value = ((throttle & 0x7ff) << 1) | (telemetry ? 1 : 0);
+    uint16_t crc = (value ^ (value >> 4) ^ (value >> 8)) & 0xf;
+    return (value << 4) | crc;
+}
+
+/** Fill `buf` with one timer compare value per bit of `frame`
+ *
+ * `buf` must have room for FrameBits + `idleBits` values. The idle bits at the
+ * end are 0, so the line stays low once the frame is sent.
+ */
+inline void fillBitBuffer(uint16_t frame, uint16_t *buf, uint16_t oneTicks, uint16_t zeroTicks, uint32_t idleBits) {
+    for(uint32_t i = 0; i < FrameBits; i++) {
+        buf[i] = (frame & (0x8000 >> i)) ? oneTicks : zeroTicks;
+    }
+    for(uint32_t i = 0; i < idleBits; i++) {
+        buf[FrameBits + i] = 0;
+    }
+}
+
+/** Map a servo pulse width, as output by MotorControl, to a DShot throttle
+ *
+ * 1000 us and below is stop, and 1000-2000 us maps over the throttle range.
+ */
+inline uint16_t throttleFromPulseWidth(uint32_t widthUs) {
+    if(widthUs <= 1000) {
+        return 0;
+    }
+    if(widthUs >= 2000) {
+        return MaxThrottle;
+    }
+    return MinThrottle + (widthUs - 1000) * (MaxThrottle - MinThrottle) / 1000;
+}
+
+} // namespace dshot
@@ -1,23 +1,50 @@
 #pragma once
 
+#include "Placement.hpp"
+
 #define limit(min, x, max) {x < min ? min : (x > max ? max :x)}
 
 class MotorControl {
 public:
+    static constexpr float DefaultKp = 1.0;
+    static constexpr float DefaultKi = 0.005;
+    static constexpr float DefaultKd = 0.3;
+
     MotorControl() :
         integrator(0.0),
         output(0.0),
         targetRpm(0.0),
-        lastError(0.0)
+        lastError(0.0),
+        Kp(DefaultKp),
+        Ki(DefaultKi),
+        Kd(DefaultKd)
     {
 
     }
 
+    void setGains(float kp, float ki, float kd) {
+        Kp = kp;
+        Ki = ki;
+        Kd = kd;
+    }
+
+    float getKp() const {
+        return Kp;
+    }
+
+    float getKi() const {
+        return Ki;
+    }
+
+    float getKd() const {
+        return Kd;
+    }
+
     void set_speed(float rpm) {
         targetRpm = rpm;
     }
 
-    float update(float current_rpm) {
+    HOT_CODE float update(float current_rpm) {
         if(targetRpm < 1.0) {
             output = OffPwm;
         } else {
@@ -37,13 +64,13 @@ private:
     float output;
     float targetRpm;
     float lastError;
+    float Kp;
+    float Ki;
+    float Kd;
 
     static constexpr float OffPwm = 1000.0;
     static constexpr float MinPwm = 1050.0;
     static constexpr float MaxPwm = 1800.0;
     static constexpr float IMax = 150.0;
-    static constexpr float Kp = 1.0;
-    static constexpr float Ki = 0.005;
-    static constexpr float Kd = 0.3;
     static constexpr float ErrorLimit = 75;
  };
\ No newline at end of file
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+/** Revolution period statistics, for spotting imbalance and bearing wear
+ *
+ * Fed with every measured revolution period, it computes over blocks of
+ * `BlockSize` revolutions:
+ * - mean and standard deviation of the period, by Welford's method
+ * - peak to peak period deviation
+ * - amplitude of the lowest `Harmonics` DFT bins of the period sequence, i.e.
+ *   period modulation repeating every BlockSize/k revolutions, as from a
+ *   wafer walking on the chuck or a bearing cage defect
+ *
+ * Each push() costs the same, a handful of float operations per harmonic.
+ * Only the last push() of a block does a few square roots to publish the
+ * result, and the accumulators then start over, so alarms reflect recent
+ * behavior rather than the whole run.
+ *
+ * Alarm limits are relative to the mean period, in parts per thousand, on
+ * top of what the period measurement itself can't resolve: with edges timed
+ * to the nearest sample, a steady period alone shows up to half a sample of
+ * standard deviation, a sample peak to peak, and a quarter of a sample in a
+ * harmonic when its fraction of a sample beats slowly. At 10 samples per
+ * revolution that is 50 per mille of standard deviation, more than any
+ * sensible limit.
+ */
+template<uint32_t BlockSize, uint32_t Harmonics>
+class PeriodAnalytics {
+public:
+    static_assert((BlockSize & (BlockSize - 1)) == 0, "Block size must be a power of two");
+    static_assert(Harmonics > 0 && Harmonics < BlockSize / 2, "Invalid number of harmonics");
+
+    enum Alarm : uint8_t {
+        StdDevAlarm = 1,
+        PeakToPeakAlarm = 2,
+        HarmonicAlarm = 4
+    };
+
+    struct Limits {
+        uint32_t stdDevPermille;
+        uint32_t peakToPeakPermille;
+        uint32_t harmonicPermille;
+        // Smallest period step measured, in the units of push(), e.g. the
+        // sample period
+        uint32_t resolution;
+    };
+
+    struct Result {
+        float mean;
+        float stdDev;
+        float peakToPeak;
+        float harmonic[Harmonics];
+        uint8_t alarms;
+    };
+
+    PeriodAnalytics(const Limits &_limits) : limits(_limits), blocks(0), result{} {
+        for(uint32_t i = 0; i < BlockSize; i++) {
+            cosTable[i] = cosf(2.0f * (float)M_PI * i / BlockSize);
+        }
+        reset();
+    }
+
+    /** Drop the block in progress, e.g. when the signal is lost */
+    void reset() {
+        n = 0;
+        mean = 0.0f;
+        m2 = 0.0f;
+        minPeriod = INFINITY;
+        maxPeriod = 0.0f;
+        for(uint32_t k = 0; k < Harmonics; k++) {
+            re[k] = 0.0f;
+            im[k] = 0.0f;
+            phase[k] = 0;
+        }
+    }
+
+    void push(float period) {
+        n++;
+        float delta = period - mean;
+        mean += delta / n;
+        m2 += delta * (period - mean);
+        if(period < minPeriod) {
+            minPeriod = period;
+        }
+        if(period > maxPeriod) {
+            maxPeriod = period;
+        }
+
+        // Bin k advances k steps around the table per period; sine is the
+        // cosine a quarter turn later
+        for(uint32_t k = 0; k < Harmonics; k++) {
+            re[k] += period * cosTable[phase[k]];
+            im[k] += period * cosTable[(phase[k] + BlockSize * 3 / 4) & (BlockSize - 1)];
+            phase[k] = (phase[k] + k + 1) & (BlockSize - 1);
+        }
+
+        if(n == BlockSize) {
+            publish();
+            reset();
+        }
+    }
+
+    /** Number of blocks completed, so callers can tell when there is a new result */
+    uint32_t getBlocks() const {
+        return blocks;
+    }
+
+    /** Result of the last complete block */
+    const Result& getResult() const {
+        return result;
+    }
+
+private:
+    void publish() {
+        result.mean = mean;
+        result.stdDev = sqrtf(m2 / (BlockSize - 1));
+        result.peakToPeak = maxPeriod - minPeriod;
+        result.alarms = 0;
+        float scale = mean / 1000.0f;
+        float resolution = limits.resolution;
+        if(result.stdDev > limits.stdDevPermille * scale + resolution * 0.5f) {
+            result.alarms |= StdDevAlarm;
+        }
+        if(result.peakToPeak > limits.peakToPeakPermille * scale + resolution) {
+            result.alarms |= PeakToPeakAlarm;
+        }
+        for(uint32_t k = 0; k < Harmonics; k++) {
+            result.harmonic[k] = 2.0f * sqrtf(re[k] * re[k] + im[k] * im[k]) / BlockSize;
+            if(result.harmonic[k] > limits.harmonicPermille * scale + resolution * 0.25f) {
+                result.alarms |= HarmonicAlarm;
+            }
+        }
+        blocks++;
+    }
+
+    Limits limits;
+    float cosTable[BlockSize];
+    uint32_t n;
+    float mean;
+    float m2;
+    float minPeriod;
+    float maxPeriod;
+    float re[Harmonics];
+    float im[Harmonics];
+    uint32_t phase[Harmonics];
+    uint32_t blocks;
+    Result result;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+/** Memory placement of hot code and data
+ *
+ * At 170 MHz, flash needs 4 wait states. The ART cache hides most of them for
+ * tight loops, but code which runs every millisecond between long UI redraws
+ * (the tach ISRs and edge detector) is usually evicted by then. Functions
+ * marked HOT_CODE are copied to CCM SRAM at startup, and run from there with
+ * no wait states and no cache to miss.
+ *
+ * Mark ISRs with `MODM_ISR(NAME, HOT_CODE)`, and functions by putting
+ * HOT_CODE before the return type. Only mark code which is short and runs
+ * often: CCM is 10 KB, and anything the hot function calls which isn't
+ * inlined, and isn't marked, still runs from flash.
+ *
+ * HOT_DATA keeps data the hot code works on in SRAM, which has no wait
+ * states either.
+ *
+ * `make placement` lists the symbols in each memory after a build.
+ */
+#if __has_include(<modm/architecture/utils.hpp>)
+#include <modm/architecture/utils.hpp>
+#define HOT_CODE modm_fastcode
+#define HOT_DATA modm_fastdata
+#else
+// Host builds, e.g. of the tests in test/, have only the one memory
+#define HOT_CODE
+#define HOT_DATA
+#endif
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+/** A spin recipe: a list of speeds, each held for a set time
+ *
+ * Called once per control period while running, update() returns the speed
+ * setpoint, and the recipe stops by itself after the last step.
+ */
+template<uint8_t MaxSteps>
+class Recipe {
+public:
+    struct Step {
+        uint16_t rpm;
+        uint32_t durationMs;
+    };
+
+    Recipe() : numSteps(0), step(0), stepElapsedMs(0), running(false) {}
+
+    void clear() {
+        running = false;
+        numSteps = 0;
+    }
+
+    /** Append a step
+     *
+     * @return false if the recipe is full, or running
+     */
+    bool add(uint16_t rpm, uint32_t durationMs) {
+        if(running || numSteps == MaxSteps) {
+            return false;
+        }
+        steps[numSteps++] = {rpm, durationMs};
+        return true;
+    }
+
+    uint8_t getNumSteps() const {
+        return numSteps;
+    }
+
+    const Step& getStep(uint8_t i) const {
+        return steps[i];
+    }
+
+    /** @return false if there are no steps */
+    bool start() {
+        if(numSteps == 0) {
+            return false;
+        }
+        step = 0;
+        stepElapsedMs = 0;
+        running = true;
+        return true;
+    }
+
+    void stop() {
+        running = false;
+    }
+
+    bool isRunning() const {
+        return running;
+    }
+
+    /** Index of the step in progress */
+    uint8_t getCurrentStep() const {
+        return step;
+    }
+
+    /** Advance by one control period, and get the setpoint for it */
+    uint16_t update(uint32_t periodMs) {
+        if(!running) {
+            return 0;
+        }
+        if(stepElapsedMs >= steps[step].durationMs) {
+            stepElapsedMs = 0;
+            if(++step == numSteps) {
+                running = false;
+                return 0;
+            }
+        }
+        stepElapsedMs += periodMs;
+        return steps[step].rpm;
+    }
+
+private:
+    Step steps[MaxSteps];
+    uint8_t numSteps;
+    uint8_t step;
+    uint32_t stepElapsedMs;
+    bool running;
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace remote {
+
+/** Position of a token within a Line */
+struct Token {
+    uint32_t start;
+    uint32_t length;
+};
+
+/** A line of text held in place in a ring buffer
+ *
+ * The line may wrap around the end of the ring, so characters are read
+ * through at(), and tokens are kept as positions rather than copied out.
+ */
+class Line {
+public:
+    Line() : ring(0), mask(0), start(0), size(0), cursor(0) {}
+
+    Line(const uint8_t *_ring, uint32_t ringSize, uint32_t _start, uint32_t _size) :
+        ring(_ring),
+        mask(ringSize - 1),
+        start(_start),
+        size(_size),
+        cursor(0)
+    {
+
+    }
+
+    char at(uint32_t i) const {
+        return (char)ring[(start + i) & mask];
+    }
+
+    uint32_t length() const {
+        return size;
+    }
+
+    /** Get the next space separated token
+     *
+     * @return false if there are no more tokens
+     */
+    bool next(Token &token) {
+        while(cursor < size && at(cursor) == ' ') {
+            cursor++;
+        }
+        if(cursor == size) {
+            return false;
+        }
+        token.start = cursor;
+        while(cursor < size && at(cursor) != ' ') {
+            cursor++;
+        }
+        token.length = cursor - token.start;
+        return true;
+    }
+
+    /** True if there are tokens left */
+    bool more() {
+        while(cursor < size && at(cursor) == ' ') {
+            cursor++;
+        }
+        return cursor < size;
+    }
+
+    bool equals(const Token &token, const char *text) const {
+        uint32_t i = 0;
+        for(; i < token.length; i++) {
+            if(text[i] == 0 || text[i] != at(token.start + i)) {
+                return false;
+            }
+        }
+        return text[i] == 0;
+    }
+
+    bool toUint(const Token &token, uint32_t &value) const {
+        // Up to 9 digits, so that it can't overflow
+        if(token.length == 0 || token.length > 9) {
+            return false;
+        }
+        value = 0;
+        for(uint32_t i = 0; i < token.length; i++) {
+            char c = at(token.start + i);
+            if(c < '0' || c > '9') {
+                return false;
+            }
+            value = value * 10 + (c - '0');
+        }
+        return true;
+    }
+
+private:
+    const uint8_t *ring;
+    uint32_t mask;
+    uint32_t start;
+    uint32_t size;
+    uint32_t cursor;
+};
+
+/** Splits text arriving in a ring buffer into lines, without copying it
+ *
+ * The ring is written by someone else, e.g. by DMA, and next() is given the
+ * current write position. Lines end with '\n', and a '\r' before it is
+ * dropped. A line must be handled before the writer comes around the ring
+ * again, i.e. within Size bytes.
+ *
+ * Lines longer than MaxLine are dropped, up to their end, and counted.
+ */
+template<uint32_t Size, uint32_t MaxLine>
+class LineReader {
+public:
+    static_assert((Size & (Size - 1)) == 0, "Ring size must be a power of two");
+    static_assert(MaxLine < Size / 2, "Lines must fit in the ring with room to spare");
+
+    LineReader(const uint8_t *_ring) :
+        ring(_ring),
+        readIndex(0),
+        scanIndex(0),
+        dropping(false),
+        dropped(0)
+    {
+
+    }
+
+    /** Find the next complete line written before `writeIndex`
+     *
+     * @return false if there is no complete line yet
+     */
+    bool next(uint32_t writeIndex, Line &line) {
+        while(scanIndex != writeIndex) {
+            uint32_t i = scanIndex;
+            scanIndex = (scanIndex + 1) & (Size - 1);
+            if(ring[i] != '\n') {
+                continue;
+            }
+            uint32_t start = readIndex;
+            uint32_t length = (i - start) & (Size - 1);
+            readIndex = scanIndex;
+            if(dropping) {
+                dropping = false;
+                continue;
+            }
+            if(length > MaxLine) {
+                dropped++;
+                continue;
+            }
+            if(length > 0 && ring[(start + length - 1) & (Size - 1)] == '\r') {
+                length--;
+            }
+            line = Line(ring, Size, start, length);
+            return true;
+        }
+
+        // No end of line yet; give up on a line which is too long
+        if(((writeIndex - readIndex) & (Size - 1)) > MaxLine) {
+            if(!dropping) {
+                dropped++;
+            }
+            dropping = true;
+            readIndex = writeIndex;
+        }
+        return false;
+    }
+
+    uint32_t getDropped() const {
+        return dropped;
+    }
+
+private:
+    const uint8_t *ring;
+    uint32_t readIndex;
+    uint32_t scanIndex;
+    bool dropping;
+    uint32_t dropped;
+};
+
+} // namespace remote
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <modm/platform.hpp>
+#include <modm/architecture/interface/clock.hpp>
+
+/** Cooperative, priority ordered task scheduler with a static task table
+ *
+ * Tasks are plain functions which run to completion. A task becomes runnable
+ * either when its period elapses, or when it is signalled, e.g. from an ISR.
+ * Among runnable tasks, the one with the lowest priority number runs first,
+ * and ties are broken by the earliest deadline.
+ *
+ * When nothing is runnable, the core sleeps with WFI until the next interrupt.
+ * Periodic tasks rely on some interrupt to wake the core for their release
+ * time; here the 1 kHz tach sampling timer does that, so periodic release
+ * jitter is bounded to 1 ms.
+ *
+ * For each task the scheduler records the number of runs, the total and worst
+ * case runtime, and the number of deadline misses, i.e. runs which finished
+ * more than `deadlineUs` after the task was released.
+ */
+template<uint8_t MaxTasks>
+class Scheduler {
+public:
+    using Handler = void (*)();
+    using TaskId = uint8_t;
+
+    static_assert(MaxTasks <= 32, "Pending task flags are kept in a 32-bit mask");
+
+    // Returned by addTask() when the task table is full
+    static const TaskId InvalidTask = 0xff;
+
+    struct Stats {
+        uint32_t runs;
+        uint32_t totalUs;
+        uint32_t maxUs;
+        uint32_t deadlineMisses;
+    };
+
+    Scheduler() : numTasks(0), pending(0), idleUs(0) {}
+
+    /** Add a task
+     *
+     * @param periodUs Release period, or 0 for a task which only runs when
+     * signalled
+     * @param deadlineUs Allowed time from release to completion, or 0 for no
+     * deadline
+     * @return the task's id, or InvalidTask if there are already MaxTasks
+     */
+    TaskId addTask(const char *name, Handler handler, uint8_t priority, uint32_t periodUs = 0, uint32_t deadlineUs = 0) {
+        if(numTasks >= MaxTasks) {
+            return InvalidTask;
+        }
+        TaskId id = numTasks++;
+        Task &t = tasks[id];
+        t.name = name;
+        t.handler = handler;
+        t.priority = priority;
+        t.periodUs = periodUs;
+        t.deadlineUs = deadlineUs;
+        t.nextReleaseUs = now() + periodUs;
+        t.releasedUs = 0;
+        t.released = false;
+        t.stats = {};
+        return id;
+    }
+
+    /** Make a task runnable. Safe to call from an ISR. Invalid ids are ignored. */
+    void signal(TaskId id) {
+        if(id >= MaxTasks) {
+            return;
+        }
+        pending.fetch_or(1u << id, std::memory_order_release);
+    }
+
+    /** Run the highest priority runnable task, if there is one
+     *
+     * @return true if a task was run
+     */
+    bool runOnce() {
+        uint32_t t = now();
+        uint32_t signalled = pending.exchange(0, std::memory_order_acquire);
+
+        int best = -1;
+        for(uint8_t i = 0; i < numTasks; i++) {
+            Task &task = tasks[i];
+            if(!task.released) {
+                if(signalled & (1u << i)) {
+                    release(task, t);
+                } else if(task.periodUs > 0 && (int32_t)(t - task.nextReleaseUs) >= 0) {
+                    release(task, task.nextReleaseUs);
+                    task.nextReleaseUs += task.periodUs;
+                    // Don't try to catch up on releases lost to an overrun
+                    if((int32_t)(t - task.nextReleaseUs) >= 0) {
+                        task.nextReleaseUs = t + task.periodUs;
+                    }
+                }
+            }
+            // A signal for a task which is already released is merged into
+            // the pending run
+
+            if(task.released && (best < 0 || before(task, tasks[best]))) {
+                best = i;
+            }
+        }
+
+        if(best < 0) {
+            return false;
+        }
+
+        Task &task = tasks[best];
+        task.released = false;
+        uint32_t start = now();
+        task.handler();
+        uint32_t end = now();
+
+        uint32_t runtime = end - start;
+        task.stats.runs++;
+        task.stats.totalUs += runtime;
+        if(runtime > task.stats.maxUs) {
+            task.stats.maxUs = runtime;
+        }
+        if(task.deadlineUs > 0 && end - task.releasedUs > task.deadlineUs) {
+            task.stats.deadlineMisses++;
+        }
+        return true;
+    }
+
+    /** Run tasks forever, sleeping whenever nothing is runnable */
+    [[noreturn]] void run() {
+        while(true) {
+            if(!runOnce()) {
+                sleep();
+            }
+        }
+    }
+
+    const Stats& getStats(TaskId id) const {
+        return tasks[id].stats;
+    }
+
+    const char* getName(TaskId id) const {
+        return tasks[id].name;
+    }
+
+    uint8_t getNumTasks() const {
+        return numTasks;
+    }
+
+    /** Restart the statistics of all tasks */
+    void clearStats() {
+        for(uint8_t i = 0; i < numTasks; i++) {
+            tasks[i].stats = {};
+        }
+    }
+
+    /** Total time spent sleeping in WFI */
+    uint32_t getIdleUs() const {
+        return idleUs;
+    }
+
+private:
+    struct Task {
+        const char *name;
+        Handler handler;
+        uint8_t priority;
+        uint32_t periodUs;
+        uint32_t deadlineUs;
+        uint32_t nextReleaseUs;
+        uint32_t releasedUs;
+        bool released;
+        Stats stats;
+    };
+
+    static uint32_t now() {
+        return modm::chrono::micro_clock::now().time_since_epoch().count();
+    }
+
+    static void release(Task &task, uint32_t t) {
+        task.released = true;
+        task.releasedUs = t;
+    }
+
+    static bool before(const Task &a, const Task &b) {
+        if(a.priority != b.priority) {
+            return a.priority < b.priority;
+        }
+        if(a.deadlineUs == 0) {
+            return false;
+        }
+        if(b.deadlineUs == 0) {
+            return true;
+        }
+        return (int32_t)((a.releasedUs + a.deadlineUs) - (b.releasedUs + b.deadlineUs)) < 0;
+    }
+
+    void sleep() {
+        uint32_t start = now();
+        // Interrupts are masked so that a signal arriving after the check can't
+        // be missed; WFI still wakes on the pending interrupt, which is then
+        // taken as soon as they are unmasked.
+        __disable_irq();
+        if(pending.load(std::memory_order_relaxed) == 0) {
+            __WFI();
+        }
+        __enable_irq();
+        idleUs += now() - start;
+    }
+
+    Task tasks[MaxTasks];
+    uint8_t numTasks;
+    std::atomic<uint32_t> pending;
+    uint32_t idleUs;
+};
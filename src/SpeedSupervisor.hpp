@@ -0,0 +1,180 @@
+#pragma once
+
+#include <stdint.h>
+
+/** Watches the tach against the speed setpoint, and trips on faults
+ *
+ * Checked every `periodMs`, it trips on:
+ * - TachLoss: no tach edge for `TachLossFactor` times the last measured
+ *   revolution period, bounded by MinTachTimeoutMs and MaxTachTimeoutMs. At
+ *   6000 RPM that is 30 ms, rather than the tach's fixed one second timeout.
+ *   Only armed once a period has been measured while the motor is driven;
+ *   the last one measured is kept, as the tach drops its periods on its own
+ *   timeout.
+ * - SpinUpTimeout: below half the setpoint for longer than `spinUpMs`, e.g.
+ *   a stalled rotor or a slipped tach sensor which never saw an edge.
+ * - Overspeed: above the absolute limit, or for longer than `overspeedMs`
+ *   above the setpoint plus margin. After the setpoint is lowered, the
+ *   allowed speed falls at `decelRpmPerS` rather than at once, so that a
+ *   rotor coasting down isn't mistaken for a runaway.
+ *
+ * A fault latches until clear() is called. The owner is responsible for
+ * stopping the motor when update() returns a fault.
+ */
+class SpeedSupervisor {
+public:
+    enum class Fault : uint8_t {
+        None,
+        TachLoss,
+        SpinUpTimeout,
+        Overspeed
+    };
+
+    struct Config {
+        uint32_t tachLossFactor;
+        uint32_t minTachTimeoutMs;
+        uint32_t maxTachTimeoutMs;
+        uint32_t spinUpMs;
+        uint32_t overspeedRpm;
+        uint32_t overspeedMarginRpm;
+        uint32_t overspeedMs;
+        uint32_t decelRpmPerS;
+    };
+
+    SpeedSupervisor(const Config &_config) : config(_config) {
+        clear();
+    }
+
+    void clear() {
+        fault = Fault::None;
+        faultRpm = 0;
+        detectionMs = 0;
+        belowMs = 0;
+        overMs = 0;
+        allowedRpm = 0;
+        lastRevPeriodMs = 0;
+    }
+
+    /** Tach loss timeout for a revolution period, or 0 if there is none */
+    uint32_t tachTimeoutMs(uint32_t revPeriodMs) const {
+        if(revPeriodMs == 0) {
+            return 0;
+        }
+        uint32_t timeout = revPeriodMs * config.tachLossFactor;
+        if(timeout < config.minTachTimeoutMs) {
+            return config.minTachTimeoutMs;
+        }
+        if(timeout > config.maxTachTimeoutMs) {
+            return config.maxTachTimeoutMs;
+        }
+        return timeout;
+    }
+
+    /** Check the latest tach reading
+     *
+     * @param setpointRpm Speed being commanded; 0 when the motor is off
+     * @param rpm Measured speed
+     * @param revPeriodMs Measured revolution period, 0 if not known
+     * @param msSinceEdge Time since the last tach edge
+     * @param periodMs Time since the previous call
+     * @return The fault, if one has tripped now or before
+     */
+    Fault update(uint32_t setpointRpm, uint32_t rpm, uint32_t revPeriodMs, uint32_t msSinceEdge, uint32_t periodMs) {
+        if(fault != Fault::None) {
+            return fault;
+        }
+
+        // Allowed speed follows the setpoint up at once, and down at the
+        // deceleration limit
+        uint32_t decel = config.decelRpmPerS * periodMs / 1000;
+        if(setpointRpm >= allowedRpm) {
+            allowedRpm = setpointRpm;
+        } else if(allowedRpm - setpointRpm > decel) {
+            allowedRpm -= decel;
+        } else {
+            allowedRpm = setpointRpm;
+        }
+
+        if(rpm > config.overspeedRpm) {
+            return trip(Fault::Overspeed, rpm, 0);
+        }
+        if(rpm > allowedRpm + config.overspeedMarginRpm) {
+            overMs += periodMs;
+            if(overMs > config.overspeedMs) {
+                return trip(Fault::Overspeed, rpm, overMs);
+            }
+        } else {
+            overMs = 0;
+        }
+
+        if(setpointRpm == 0) {
+            // Coasting down, or stopped; the tach is expected to go quiet
+            belowMs = 0;
+            lastRevPeriodMs = 0;
+            return Fault::None;
+        }
+
+        if(revPeriodMs > 0) {
+            lastRevPeriodMs = revPeriodMs;
+        }
+        uint32_t timeout = tachTimeoutMs(lastRevPeriodMs);
+        if(timeout > 0 && msSinceEdge > timeout) {
+            return trip(Fault::TachLoss, rpm, msSinceEdge);
+        }
+
+        if(rpm < setpointRpm / 2) {
+            belowMs += periodMs;
+            if(belowMs > config.spinUpMs) {
+                return trip(Fault::SpinUpTimeout, rpm, belowMs);
+            }
+        } else {
+            belowMs = 0;
+        }
+        return Fault::None;
+    }
+
+    Fault getFault() const {
+        return fault;
+    }
+
+    /** Measured speed when the fault tripped */
+    uint32_t getFaultRpm() const {
+        return faultRpm;
+    }
+
+    /** How long the fault condition lasted before it tripped */
+    uint32_t getDetectionMs() const {
+        return detectionMs;
+    }
+
+    static const char* faultName(Fault f) {
+        switch(f) {
+        case Fault::TachLoss:
+            return "TACH_LOSS";
+        case Fault::SpinUpTimeout:
+            return "SPIN_UP_TIMEOUT";
+        case Fault::Overspeed:
+            return "OVERSPEED";
+        default:
+            return "NONE";
+        }
+    }
+
+private:
+    Fault trip(Fault f, uint32_t rpm, uint32_t ms) {
+        fault = f;
+        faultRpm = rpm;
+        detectionMs = ms;
+        return f;
+    }
+
+    Config config;
+    Fault fault;
+    uint32_t faultRpm;
+    uint32_t detectionMs;
+    uint32_t belowMs;
+    uint32_t overMs;
+    uint32_t allowedRpm;
+    // Last revolution period measured since the motor was started
+    uint32_t lastRevPeriodMs;
+};
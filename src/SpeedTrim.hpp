@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+
+/** Slow outer speed loop for open-loop motor controllers
+ *
+ * The STSPIN controller runs the motor open loop at the commanded electrical
+ * rate, so slip, or a wrong pole pair count, shows up as a steady speed error.
+ * This trims the command by a scale factor, integrated from the measured speed
+ * error. Both sources of error are proportional to speed, so the factor
+ * carries over when the setpoint changes.
+ *
+ * To stay out of the way of the controller's own ramp, the factor only moves
+ * once the setpoint has been unchanged for `settleMs`, and then by at most
+ * `maxRatePermillePerS` per second, so the command never changes faster than
+ * the controller can follow. It is limited to +/- `maxTrimPermille`, and kept
+ * while the motor is stopped, so the next run starts out trimmed.
+ */
+class SpeedTrim {
+public:
+    struct Config {
+        // Fraction of the relative speed error corrected per second
+        float gain;
+        uint32_t maxTrimPermille;
+        uint32_t maxRatePermillePerS;
+        uint32_t settleMs;
+    };
+
+    SpeedTrim(const Config &_config) : config(_config), trim(0.0f), lastSetpoint(0), settledMs(0) {}
+
+    void reset() {
+        trim = 0.0f;
+        lastSetpoint = 0;
+        settledMs = 0;
+    }
+
+    /** Get the trimmed command for one control period
+     *
+     * @param setpointRpm Wanted speed; 0 stops
+     * @param rpm Measured speed, 0 if unknown
+     * @param periodMs Control period
+     */
+    uint32_t update(uint32_t setpointRpm, uint32_t rpm, uint32_t periodMs) {
+        if(setpointRpm == 0) {
+            lastSetpoint = 0;
+            settledMs = 0;
+            return 0;
+        }
+        if(setpointRpm != lastSetpoint) {
+            lastSetpoint = setpointRpm;
+            settledMs = 0;
+        } else if(settledMs < config.settleMs) {
+            settledMs += periodMs;
+        } else if(rpm > 0) {
+            float dt = periodMs / 1000.0f;
+            float error = ((float)setpointRpm - (float)rpm) / setpointRpm;
+            float step = config.gain * error * dt;
+            float maxStep = config.maxRatePermillePerS / 1000.0f * dt;
+            if(step > maxStep) {
+                step = maxStep;
+            } else if(step < -maxStep) {
+                step = -maxStep;
+            }
+            float maxTrim = config.maxTrimPermille / 1000.0f;
+            trim += step;
+            if(trim > maxTrim) {
+                trim = maxTrim;
+            } else if(trim < -maxTrim) {
+                trim = -maxTrim;
+            }
+        }
+        return (uint32_t)(setpointRpm * (1.0f + trim) + 0.5f);
+    }
+
+    /** Current trim, as a fraction of the setpoint */
+    float getTrim() const {
+        return trim;
+    }
+
+private:
+    Config config;
+    float trim;
+    uint32_t lastSetpoint;
+    uint32_t settledMs;
+};
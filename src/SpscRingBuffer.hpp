@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <span>
+
+/** Lock-free single-producer/single-consumer ring buffer
+ *
+ * Intended for passing data from one ISR to one task (or the other way). Only
+ * the producer may call `push`, and only the consumer may call `pop`.
+ *
+ * The head and tail indices run freely and are masked on access, so N must be
+ * a power of two and all N slots are usable. The producer publishes an element
+ * with a release store of `head` after writing it, and the consumer frees a slot
+ * with a release store of `tail` after reading it, which gives the barriers
+ * needed on the M4 as well as on a multi-core host.
+ *
+ * When the buffer is full, the new element is dropped rather than overwriting
+ * unread data, and the overrun counter is incremented. The high-water mark
+ * records the largest fill level seen by the producer.
+ */
+template<typename T, uint32_t N>
+class SpscRingBuffer {
+public:
+    static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRingBuffer size must be a power of two");
+
+    static constexpr uint32_t Capacity = N;
+
+    SpscRingBuffer() : head(0), tail(0), overruns(0), highWater(0) {}
+
+    /** Add an element. Producer only.
+     *
+     * @return false if the buffer was full and the element was dropped
+     */
+    bool push(const T &value) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        uint32_t used = h - tail.load(std::memory_order_acquire);
+        if(used >= N) {
+            overruns.store(overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        buffer[h & Mask] = value;
+        head.store(h + 1, std::memory_order_release);
+        if(used + 1 > highWater.load(std::memory_order_relaxed)) {
+            highWater.store(used + 1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /** Remove one element. Consumer only.
+     *
+     * @return false if the buffer was empty
+     */
+    bool pop(T &value) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if(t == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = buffer[t & Mask];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Remove up to `out.size()` elements into `out`. Consumer only.
+     *
+     * @return the number of elements copied
+     */
+    uint32_t pop(std::span<T> out) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        uint32_t available = head.load(std::memory_order_acquire) - t;
+        uint32_t count = available < out.size() ? available : out.size();
+        // Copy in at most two runs, up to the end of storage and from the start
+        uint32_t start = t & Mask;
+        uint32_t first = count < N - start ? count : N - start;
+        for(uint32_t i = 0; i < first; i++) {
+            out[i] = buffer[start + i];
+        }
+        for(uint32_t i = first; i < count; i++) {
+            out[i] = buffer[i - first];
+        }
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+
+    /** Number of elements waiting. Exact only when called by the consumer. */
+    uint32_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /** Number of elements dropped because the buffer was full */
+    uint32_t getOverruns() const {
+        return overruns.load(std::memory_order_relaxed);
+    }
+
+    /** Largest number of elements that were waiting at once */
+    uint32_t getHighWater() const {
+        return highWater.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr uint32_t Mask = N - 1;
+
+    T buffer[N];
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    // Only written by the producer
+    std::atomic<uint32_t> overruns;
+    std::atomic<uint32_t> highWater;
+};
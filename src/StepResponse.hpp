@@ -0,0 +1,210 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** Step response metrics, measured online from speed samples
+ *
+ * After start() with the speed before and after the step, feed every speed
+ * sample, taken at a fixed period, to update(). All metrics are relative to
+ * the step size, so steps up and down are handled alike:
+ *
+ * - rise time: from 10% to 90% of the step
+ * - overshoot: largest excursion past the target, in % of the step
+ * - settling time: from the step until the speed last entered the band of
+ *   +/-SettleBandPct of the step around the target, and stayed there
+ * - ripple: peak to peak speed over the last RippleFraction of the hold time
+ *
+ * Nothing is stored per sample, so the hold time is not limited by RAM.
+ */
+class StepResponse {
+public:
+    static const uint32_t SettleBandPct = 5;
+    // Ripple is measured over the last 1/RippleFraction of the hold time
+    static const uint32_t RippleFraction = 4;
+    // Marks a time that was never reached
+    static const uint32_t NotReached = UINT32_MAX;
+
+    struct Result {
+        uint16_t targetRpm;
+        uint32_t riseMs;
+        uint32_t overshootPct;
+        uint32_t settleMs;
+        uint32_t rippleRpm;
+    };
+
+    void start(uint16_t fromRpm, uint16_t toRpm, uint32_t _samplePeriodMs, uint32_t _holdMs) {
+        from = fromRpm;
+        to = toRpm;
+        samplePeriodMs = _samplePeriodMs;
+        holdMs = _holdMs;
+        elapsedMs = 0;
+        rise10Ms = NotReached;
+        rise90Ms = NotReached;
+        settledSinceMs = NotReached;
+        maxProgress = 0;
+        rippleMin = UINT32_MAX;
+        rippleMax = 0;
+    }
+
+    /** Add a sample
+     *
+     * @return true once the hold time is over
+     */
+    bool update(uint32_t rpm) {
+        elapsedMs += samplePeriodMs;
+
+        // Progress towards the target in 1/1000 of the step
+        int32_t step = (int32_t)to - (int32_t)from;
+        int32_t progress = step != 0 ? ((int32_t)rpm - (int32_t)from) * 1000 / step : 1000;
+
+        if(rise10Ms == NotReached && progress >= 100) {
+            rise10Ms = elapsedMs;
+        }
+        if(rise90Ms == NotReached && progress >= 900) {
+            rise90Ms = elapsedMs;
+        }
+        if(progress > maxProgress) {
+            maxProgress = progress;
+        }
+
+        int32_t error = progress - 1000;
+        bool inBand = error <= (int32_t)SettleBandPct * 10 && error >= -(int32_t)SettleBandPct * 10;
+        if(!inBand) {
+            settledSinceMs = NotReached;
+        } else if(settledSinceMs == NotReached) {
+            settledSinceMs = elapsedMs;
+        }
+
+        if(elapsedMs > holdMs - holdMs / RippleFraction) {
+            if(rpm < rippleMin) {
+                rippleMin = rpm;
+            }
+            if(rpm > rippleMax) {
+                rippleMax = rpm;
+            }
+        }
+        return elapsedMs >= holdMs;
+    }
+
+    Result getResult() const {
+        Result r;
+        r.targetRpm = to;
+        r.riseMs = (rise10Ms != NotReached && rise90Ms != NotReached) ? rise90Ms - rise10Ms : NotReached;
+        r.overshootPct = maxProgress > 1000 ? (maxProgress - 1000) / 10 : 0;
+        r.settleMs = settledSinceMs;
+        r.rippleRpm = rippleMax >= rippleMin ? rippleMax - rippleMin : 0;
+        return r;
+    }
+
+private:
+    uint16_t from;
+    uint16_t to;
+    uint32_t samplePeriodMs;
+    uint32_t holdMs;
+    uint32_t elapsedMs;
+    uint32_t rise10Ms;
+    uint32_t rise90Ms;
+    uint32_t settledSinceMs;
+    int32_t maxProgress;
+    uint32_t rippleMin;
+    uint32_t rippleMax;
+};
+
+/** Steps the speed setpoint through a list of speeds and measures each step
+ *
+ * Called once per control period with the measured speed, it returns the
+ * setpoint to use. Each speed is held for `holdMs`. The first step starts from
+ * standstill, and every other from the previous speed. The setpoint returns to
+ * 0 when the list is done.
+ */
+template<uint8_t MaxSteps>
+class StepTest {
+public:
+    StepTest() :
+        speeds(NULL),
+        numSteps(0),
+        step(0),
+        running(false),
+        complete(false),
+        issued(false)
+    {
+
+    }
+
+    void start(const uint16_t *_speeds, uint8_t _numSteps, uint32_t _samplePeriodMs, uint32_t _holdMs) {
+        speeds = _speeds;
+        numSteps = _numSteps < MaxSteps ? _numSteps : MaxSteps;
+        samplePeriodMs = _samplePeriodMs;
+        holdMs = _holdMs;
+        step = 0;
+        running = numSteps > 0;
+        complete = false;
+        issued = false;
+        if(running) {
+            response.start(0, speeds[0], samplePeriodMs, holdMs);
+        }
+    }
+
+    void abort() {
+        running = false;
+    }
+
+    bool isRunning() const {
+        return running;
+    }
+
+    /** True if the last test ran through all steps */
+    bool isComplete() const {
+        return complete;
+    }
+
+    /** Index of the step in progress */
+    uint8_t getStep() const {
+        return step;
+    }
+
+    uint8_t getNumSteps() const {
+        return numSteps;
+    }
+
+    const StepResponse::Result& getResult(uint8_t i) const {
+        return results[i];
+    }
+
+    /** Feed a speed measurement, and get the setpoint for the next period */
+    uint16_t update(uint32_t rpm) {
+        if(!running) {
+            return 0;
+        }
+        // The measurement passed with the first setpoint is from before the
+        // step, so it starts with the next one
+        if(!issued) {
+            issued = true;
+            return speeds[0];
+        }
+        if(response.update(rpm)) {
+            results[step] = response.getResult();
+            step++;
+            if(step == numSteps) {
+                running = false;
+                complete = true;
+                return 0;
+            }
+            response.start(speeds[step - 1], speeds[step], samplePeriodMs, holdMs);
+        }
+        return speeds[step];
+    }
+
+private:
+    const uint16_t *speeds;
+    uint8_t numSteps;
+    uint8_t step;
+    bool running;
+    bool complete;
+    bool issued;
+    uint32_t samplePeriodMs;
+    uint32_t holdMs;
+    StepResponse response;
+    StepResponse::Result results[MaxSteps];
+};
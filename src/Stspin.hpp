@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace stspin {
+
+// Size of an RPM command frame
+static const uint32_t FrameSize = 11;
+
+/** Serialize an RPM command for the STSPIN motor controller with address `id` */
+inline void encodeRpmCommand(uint8_t *buf, uint16_t id, uint32_t rpm, uint8_t polePairs) {
+    // Scale RPM to the units used by the motor controller, which are
+    // electrical rev/s times 100
+    // polePairs electrical revs per mechanical rev (property of motor)
+    // 60 RPM per RPS
+    // 100 scale factor for units
+    uint32_t scaled_electrical_rps = rpm * polePairs * 100 / 60;
+
+    // Really hacky message serializer lives here.
+    // Sync bytes
+    buf[0] = 2;
+    buf[1] = 3;
+    // ID, little endian like the data
+    buf[2] = id & 0xff;
+    buf[3] = id >> 8;
+    // length
+    buf[4] = 4;
+    // Data
+    *((uint32_t *)&buf[5]) = scaled_electrical_rps;
+    // checksum
+    buf[9] = 0;
+    buf[10] = 0;
+    for(uint32_t i=0; i<9; i++) {
+        buf[9] += buf[i];
+        buf[10] += buf[9];
+    }
+}
+
+/** Command state of one STSPIN controller on a shared UART */
+class Motor {
+public:
+    Motor() : id(0), polePairs(7), rpm(0) {}
+
+    void setId(uint16_t newId) {
+        id = newId;
+    }
+
+    uint16_t getId() const {
+        return id;
+    }
+
+    void setPolePairs(uint8_t newPolePairs) {
+        polePairs = newPolePairs;
+    }
+
+    void setSpeed(uint32_t newRpm) {
+        rpm = newRpm;
+    }
+
+    uint32_t getSpeed() const {
+        return rpm;
+    }
+
+    void encode(uint8_t *buf) const {
+        encodeRpmCommand(buf, id, rpm, polePairs);
+    }
+
+private:
+    uint16_t id;
+    uint8_t polePairs;
+    uint32_t rpm;
+};
+
+/** Several STSPIN controllers sharing one UART, told apart by their ID
+ *
+ * send() encodes the current command of every motor into one buffer and
+ * hands it to the UART in a single write, which returns right away only if
+ * the UART transmit buffer holds the whole batch; `TxBufferSize` is that
+ * buffer's size, as set in project.xml. If the previous batch is still going
+ * out, e.g. because the period is too short for the baud rate, the new one is
+ * skipped rather than waiting, and counted.
+ *
+ * At 9600 baud a frame takes 11.5 ms on the wire, so a 100 ms period has time
+ * for 8 motors, but a 64 byte transmit buffer holds the frames of 5.
+ */
+template<class Uart, uint8_t NumMotors, uint32_t TxBufferSize>
+class Bus {
+public:
+    static_assert(NumMotors * FrameSize <= TxBufferSize,
+        "A batch of commands must fit in the UART transmit buffer; raise buffer.tx in project.xml");
+
+    Bus(const uint16_t (&ids)[NumMotors]) : skipped(0) {
+        for(uint8_t i = 0; i < NumMotors; i++) {
+            motors[i].setId(ids[i]);
+        }
+    }
+
+    Motor& motor(uint8_t i) {
+        return motors[i];
+    }
+
+    /** Send the commands of all motors
+     *
+     * @return false if the batch was skipped
+     */
+    bool send() {
+        if(!Uart::isWriteFinished()) {
+            skipped++;
+            return false;
+        }
+        for(uint8_t i = 0; i < NumMotors; i++) {
+            motors[i].encode(&buffer[i * FrameSize]);
+        }
+        Uart::write(buffer, sizeof(buffer));
+        return true;
+    }
+
+    /** Number of batches skipped because the UART was busy */
+    uint32_t getSkipped() const {
+        return skipped;
+    }
+
+private:
+    Motor motors[NumMotors];
+    uint8_t buffer[NumMotors * FrameSize];
+    uint32_t skipped;
+};
+
+} // namespace stspin
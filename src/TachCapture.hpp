@@ -0,0 +1,144 @@
+#pragma once
+
+#include <stdint.h>
+
+/** Streams raw tach ADC samples over a UART, for recording and replay
+ *
+ * Samples are packed into packets of up to `BlockSize`:
+ *
+ *     0xA5, sequence, payload length, overruns (2), first sample (2),
+ *     payload, checksum (2)
+ *
+ * Multi-byte values are little endian. The payload holds the difference of
+ * each further sample from the one before, as one signed byte, or, if it
+ * doesn't fit, the escape byte 0x80 followed by the sample itself in two
+ * bytes. A tach signal is mostly slow, so this is a little over a byte per
+ * sample: about 1.1 kB/s at 1 kHz, well within 115200 baud, even with other
+ * traffic on the port. The checksum is the same Fletcher-16 as the STSPIN
+ * frames, over everything before it.
+ *
+ * Samples lost on the way are counted in two places, so the receiver can tell
+ * where the gaps are: `overruns` is the tach sample buffer overrun count at
+ * the start of the packet, and a packet is sent early when the count changes,
+ * so that a gap always falls between two packets. A packet which doesn't fit
+ * in the UART transmit buffer is dropped, counted, and shows as a gap in the
+ * sequence.
+ *
+ * The sync byte never appears in ASCII text, so packets can share the port
+ * with the text protocol, as long as both are written from the same thread.
+ *
+ * @tparam TxBufferSize Size of the UART transmit buffer (see project.xml), so
+ *                      that a packet is only written if all of it fits
+ */
+template<class Uart, uint32_t TxBufferSize, uint32_t BlockSize>
+class TachCapture {
+public:
+    static const uint8_t Sync = 0xA5;
+    static const uint8_t Escape = 0x80;
+    static const uint32_t HeaderSize = 7;
+    static const uint32_t MaxPacketSize = HeaderSize + (BlockSize - 1) * 3 + 2;
+
+    static_assert(BlockSize >= 2 && (BlockSize - 1) * 3 <= 255, "Payload length must fit in a byte");
+
+    TachCapture() : running(false), sequence(0), count(0), length(0), packetOverruns(0), sent(0), dropped(0) {}
+
+    void start() {
+        running = true;
+        count = 0;
+    }
+
+    /** Stop, and send the samples of the packet in progress */
+    void stop() {
+        if(running && count > 0) {
+            send();
+        }
+        running = false;
+    }
+
+    bool isRunning() const {
+        return running;
+    }
+
+    /** Add samples, sending a packet whenever one is full
+     *
+     * @param overruns Samples dropped before they got here so far, e.g. by
+     *                 the tach sample buffer. The samples are taken to come
+     *                 after any new ones, so the packet in progress is sent
+     *                 first.
+     */
+    void push(const uint16_t *samples, uint32_t n, uint32_t overruns) {
+        if(!running) {
+            return;
+        }
+        if(count > 0 && n > 0 && overruns != packetOverruns) {
+            send();
+        }
+        for(uint32_t i = 0; i < n; i++) {
+            uint16_t sample = samples[i];
+            if(count == 0) {
+                buffer[3] = overruns & 0xff;
+                buffer[4] = (overruns >> 8) & 0xff;
+                buffer[5] = sample & 0xff;
+                buffer[6] = sample >> 8;
+                length = HeaderSize;
+                packetOverruns = overruns;
+            } else {
+                int32_t delta = (int32_t)sample - (int32_t)last;
+                if(delta >= -127 && delta <= 127) {
+                    buffer[length++] = (uint8_t)(int8_t)delta;
+                } else {
+                    buffer[length++] = Escape;
+                    buffer[length++] = sample & 0xff;
+                    buffer[length++] = sample >> 8;
+                }
+            }
+            last = sample;
+            if(++count == BlockSize) {
+                send();
+            }
+        }
+    }
+
+    /** Number of packets sent */
+    uint32_t getSent() const {
+        return sent;
+    }
+
+    /** Number of packets dropped because the UART couldn't take them */
+    uint32_t getDropped() const {
+        return dropped;
+    }
+
+private:
+    void send() {
+        buffer[0] = Sync;
+        buffer[1] = sequence++;
+        buffer[2] = length - HeaderSize;
+        uint8_t sum = 0;
+        uint8_t sumOfSums = 0;
+        for(uint32_t i = 0; i < length; i++) {
+            sum += buffer[i];
+            sumOfSums += sum;
+        }
+        buffer[length++] = sum;
+        buffer[length++] = sumOfSums;
+
+        if(TxBufferSize - Uart::transmitBufferSize() < length) {
+            dropped++;
+        } else {
+            Uart::write(buffer, length);
+            sent++;
+        }
+        count = 0;
+    }
+
+    bool running;
+    uint8_t sequence;
+    uint32_t count;
+    uint32_t length;
+    uint16_t last;
+    uint32_t packetOverruns;
+    uint32_t sent;
+    uint32_t dropped;
+    uint8_t buffer[MaxPacketSize];
+};
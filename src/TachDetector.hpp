@@ -0,0 +1,296 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "PeriodAnalytics.hpp"
+#include "Placement.hpp"
+
+/** Edge detector tuning for a tach with one pulse per revolution, sampled at
+ * 1 kHz
+ *
+ * The ADC side of the configuration is added by DefaultTachConfig in
+ * AnalogFrequencyCounter.hpp. The detector itself has no hardware to touch,
+ * so it also runs in the host tests.
+ */
+struct TachDetectorConfig {
+    // ADC sampling period. The application runs the sample timer, see
+    // startSampleTimer().
+    static constexpr uint32_t SamplePeriodUs = 1000;
+    // Number of periods in moving average
+    static constexpr uint32_t NumPeriods = 6;
+    // The envelope follows a new peak with a time constant of 2**AttackShift
+    // samples, and decays back towards the signal with 2**DecayShift samples.
+    // The decay must be slow compared to the longest period to be measured.
+    static constexpr uint32_t AttackShift = 1;
+    static constexpr uint32_t DecayShift = 12;
+    // Decay used while acquiring, i.e. at startup, after the signal was lost
+    // and after it collapsed, so that the envelope settles on a new signal
+    // within a few hundred samples
+    static constexpr uint32_t AcquireDecayShift = 7;
+    // Number of edges before leaving the acquire mode
+    static constexpr uint32_t AcquireEdges = 3;
+    // Rising and falling thresholds as a fraction of the envelope swing, in
+    // 1/256. The distance between them is the hysteresis.
+    static constexpr uint32_t HighThreshold = 160;
+    static constexpr uint32_t LowThreshold = 96;
+    // Minimum envelope swing, in ADC counts, for edges to be detected at all.
+    // Keeps noise from triggering edges when there is no signal.
+    static constexpr uint32_t MinSwing = 60;
+    // If no edges are measured in this time, output goes to zero
+    static constexpr uint32_t TimeoutMs = 1000;
+    // Tach pulses per revolution, e.g. pieces of tape
+    static constexpr uint32_t PulsesPerRev = 1;
+    // Jitter analytics limits, in parts per thousand of the mean period, on
+    // top of the sampling resolution (see PeriodAnalytics). Signal noise
+    // adds a few per mille of standard deviation, depending on signal
+    // quality, so tune these on the machine.
+    static constexpr uint32_t JitterStdDevPermille = 15;
+    static constexpr uint32_t JitterPeakToPeakPermille = 60;
+    static constexpr uint32_t JitterHarmonicPermille = 5;
+};
+
+/** Envelope tracking edge detector and period measurement
+ *
+ * The min and max envelopes jump to new extremes quickly and decay slowly
+ * towards the signal. Edge thresholds are placed at fixed fractions of the
+ * swing between them, so the detector adapts to signal amplitude and offset,
+ * e.g. after a change in reflectivity.
+ *
+ * A slow decay rides out noise and spikes, but after the signal shrinks, e.g.
+ * after a spike or a drop in reflectivity, the thresholds would stay above it
+ * for thousands of samples. So when edges go missing while the signal swings
+ * much less than the envelope, the envelope is set to the signal, and the
+ * detector goes back to the fast acquire decay, keeping the periods measured
+ * so far.
+ */
+template<class Config>
+class TachDetector {
+public:
+    using Analytics = PeriodAnalytics<64, 3>;
+
+    static constexpr uint32_t SamplePeriodUs = Config::SamplePeriodUs;
+    // Fixed point scale for the envelope calculations. With 12 fraction bits
+    // the slow decay still moves the envelope within a count of the signal;
+    // 12 bit samples then use the full 32 bits for the edge interpolation.
+    static constexpr uint32_t SampleScale = 4096;
+
+    static_assert(Config::LowThreshold < Config::HighThreshold && Config::HighThreshold < 256,
+        "Thresholds must be fractions of 256, with high above low");
+    static_assert(Config::PulsesPerRev > 0, "Need at least one pulse per revolution");
+    static_assert(Config::DecayShift <= 12, "Decay would stop short of the signal");
+
+    TachDetector() :
+        samplesSinceLastEdge(0),
+        envelopeMax(0),
+        envelopeMin(4095 * SampleScale),
+        acquiring(true),
+        edgeCount(0),
+        lastState(false),
+        periods{0},
+        periodInPtr(0),
+        validPeriods(0),
+        lastSample(0),
+        lastEdgeFraction(0),
+        windowSamples(0),
+        windowMax(0),
+        windowMin(UINT32_MAX),
+        periodAnalytics({
+            Config::JitterStdDevPermille,
+            Config::JitterPeakToPeakPermille,
+            Config::JitterHarmonicPermille,
+            Config::SamplePeriodUs
+        }),
+        periodInSeconds(0.0f)
+    {
+
+    }
+
+    /** Take one ADC sample */
+    HOT_CODE inline void processSample(uint16_t rawSample) {
+        uint32_t sample = rawSample * SampleScale;
+        uint32_t decayShift = acquiring ? Config::AcquireDecayShift : Config::DecayShift;
+
+        if(sample > envelopeMax) {
+            envelopeMax += (sample - envelopeMax) >> Config::AttackShift;
+        } else {
+            envelopeMax -= (envelopeMax - sample) >> decayShift;
+        }
+        if(sample < envelopeMin) {
+            envelopeMin -= (envelopeMin - sample) >> Config::AttackShift;
+        } else {
+            envelopeMin += (sample - envelopeMin) >> decayShift;
+        }
+
+        // Saturates rather than starting over, so that the time since the
+        // last edge keeps growing through a signal loss
+        if(samplesSinceLastEdge < MaxSamplesSinceEdge) {
+            samplesSinceLastEdge++;
+        }
+        if(samplesSinceLastEdge == TimeoutSamples + 1) {
+            // Signal lost
+            reacquire();
+        }
+        checkCollapse(sample);
+
+        uint32_t previous = lastSample;
+        lastSample = sample;
+        if(envelopeMax < envelopeMin + Config::MinSwing * SampleScale) {
+            return;
+        }
+        uint32_t swing = envelopeMax - envelopeMin;
+        uint32_t high = envelopeMin + (swing >> 8) * Config::HighThreshold;
+        uint32_t low = envelopeMin + (swing >> 8) * Config::LowThreshold;
+
+        if(!lastState && sample > high) {
+            lastState = true;
+            // The crossing is interpolated between the previous sample and
+            // this one, for a finer period than the sample interval
+            uint32_t fraction = 0;
+            if(previous < high) {
+                fraction = ((sample - high) << 8) / (sample - previous);
+            }
+            if(edgeCount > 0) {
+                uint32_t period256 = (samplesSinceLastEdge << 8) - fraction + lastEdgeFraction;
+                periodAnalytics.push((float)period256 * SamplePeriodUs / 256.0f);
+                periods[periodInPtr] = samplesSinceLastEdge;
+                periodInPtr = (periodInPtr + 1) % Config::NumPeriods;
+                if(validPeriods < Config::NumPeriods) {
+                    validPeriods++;
+                }
+            }
+            lastEdgeFraction = fraction;
+            samplesSinceLastEdge = 0;
+            resetWindow();
+            if(edgeCount < Config::AcquireEdges) {
+                edgeCount++;
+            } else {
+                acquiring = false;
+            }
+        } else if (lastState && sample < low) {
+            lastState = false;
+        }
+    }
+
+    /** Average the periods measured so far, so that a reading is available
+     * from the second edge on. Called after each batch of samples.
+     */
+    void update() {
+        uint32_t periodAvg = 0;
+        for(uint32_t i=0; i<Config::NumPeriods; i++) {
+            periodAvg += periods[i];
+        }
+        if(validPeriods > 0) {
+            periodInSeconds = (float)periodAvg / validPeriods * (float)SamplePeriodUs / 1e6;
+        } else {
+            periodInSeconds = 0.0f;
+        }
+    }
+
+    /** Go back to acquiring the signal, and drop the stale periods */
+    void reacquire() {
+        acquiring = true;
+        edgeCount = 0;
+        validPeriods = 0;
+        for(auto &p : periods) {
+            p = 0;
+        }
+        periodAnalytics.reset();
+        resetWindow();
+    }
+
+    /** Whether the detector is still settling on the signal */
+    bool isAcquiring() const {
+        return acquiring;
+    }
+
+    /** Time since the last edge, as of the last sample processed */
+    uint32_t getMsSinceLastEdge() const {
+        return samplesSinceLastEdge * SamplePeriodUs / 1000;
+    }
+
+    /** Average revolution period over the last few edges, or 0 if there is none */
+    uint32_t getPeriodMs() const {
+        if(validPeriods == 0) {
+            return 0;
+        }
+        return (uint32_t)(periodInSeconds * Config::PulsesPerRev * 1000.0f);
+    }
+
+    /** Period jitter statistics over the last block of pulses */
+    const Analytics& getPeriodAnalytics() const {
+        return periodAnalytics;
+    }
+
+    /** Revolutions per second, or 0 without a recent edge */
+    float getFrequency() const {
+        if(periodInSeconds > 0.0 && validPeriods > 0 && samplesSinceLastEdge < TimeoutSamples) {
+            return 1.0f / (periodInSeconds * Config::PulsesPerRev);
+        } else {
+            return 0.0f;
+        }
+    }
+
+private:
+    // Once an edge is half a period overdue, look at the signal over one
+    // period at a time. If it swings less than half the envelope, the
+    // thresholds are out of its reach, so the envelope starts over from the
+    // extremes of that period, and acquires from there. The edge after that
+    // only starts a period, as the time since the last one spans the missed
+    // edges.
+    HOT_CODE inline void checkCollapse(uint32_t sample) {
+        if(acquiring || validPeriods == 0) {
+            return;
+        }
+        uint32_t lastPeriod = periods[(periodInPtr + Config::NumPeriods - 1) % Config::NumPeriods];
+        if(samplesSinceLastEdge <= lastPeriod + lastPeriod / 2) {
+            return;
+        }
+        if(sample > windowMax) {
+            windowMax = sample;
+        }
+        if(sample < windowMin) {
+            windowMin = sample;
+        }
+        if(++windowSamples >= lastPeriod) {
+            if(windowMax - windowMin < (envelopeMax - envelopeMin) / 2) {
+                envelopeMax = windowMax;
+                envelopeMin = windowMin;
+                acquiring = true;
+                edgeCount = 0;
+            }
+            resetWindow();
+        }
+    }
+
+    void resetWindow() {
+        windowSamples = 0;
+        windowMax = 0;
+        windowMin = UINT32_MAX;
+    }
+
+    static constexpr uint32_t TimeoutSamples = Config::TimeoutMs * 1000 / SamplePeriodUs;
+    // So that getMsSinceLastEdge() can't overflow
+    static constexpr uint32_t MaxSamplesSinceEdge = UINT32_MAX / SamplePeriodUs;
+
+    uint32_t samplesSinceLastEdge;
+    uint32_t envelopeMax;
+    uint32_t envelopeMin;
+    bool acquiring;
+    // Edges seen since acquisition started; the first one only starts a period
+    uint32_t edgeCount;
+    bool lastState;
+    uint32_t periods[Config::NumPeriods];
+    uint32_t periodInPtr;
+    uint32_t validPeriods;
+    // Previous sample, and how far the last edge fell before its sample, in
+    // 1/256 samples, for interpolating edge times between samples
+    uint32_t lastSample;
+    uint32_t lastEdgeFraction;
+    // Signal extremes over the current period once an edge is overdue
+    uint32_t windowSamples;
+    uint32_t windowMax;
+    uint32_t windowMin;
+    // Every pulse period, in us, goes through the jitter analytics
+    Analytics periodAnalytics;
+    float periodInSeconds;
+};
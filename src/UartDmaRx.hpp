@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <modm/platform.hpp>
+
+/** USART2 receive into a ring buffer by circular DMA
+ *
+ * USART2 is the ST-Link virtual COM port. modm's driver is still used for
+ * transmitting, but received bytes go straight into the ring by DMA1 channel
+ * 2, with no interrupt per byte. The reader finds the write position from the
+ * DMA transfer counter.
+ *
+ * Call initialize() after the UART is set up by Board::initialize().
+ */
+template<uint32_t Size>
+class Usart2DmaRx {
+public:
+    static void initialize() {
+        RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN | RCC_AHB1ENR_DMAMUX1EN;
+        __DSB();
+
+        // Stop the driver's receive interrupt from racing the DMA for bytes
+        USART2->CR1 &= ~USART_CR1_RXNEIE;
+
+        // DMA1 channel 2 is routed through DMAMUX channel 1
+        DMAMUX1_Channel1->CCR = DmaRequestUsart2Rx;
+        DMA1_Channel2->CCR = 0;
+        DMA1_Channel2->CPAR = (uint32_t)&USART2->RDR;
+        DMA1_Channel2->CMAR = (uint32_t)ring;
+        DMA1_Channel2->CNDTR = Size;
+        // Peripheral to memory, bytes, circular
+        DMA1_Channel2->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_PL_0 | DMA_CCR_EN;
+        USART2->CR3 |= USART_CR3_DMAR;
+    }
+
+    static const uint8_t* buffer() {
+        return ring;
+    }
+
+    /** Index in the ring of the next byte to be received */
+    static uint32_t writeIndex() {
+        return (Size - DMA1_Channel2->CNDTR) & (Size - 1);
+    }
+
+private:
+    // DMAMUX request number of USART2_RX (RM0440, DMAMUX request table)
+    static const uint32_t DmaRequestUsart2Rx = 26;
+
+    static inline uint8_t ring[Size];
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <modm/platform.hpp>
+
+/** Independent watchdog, clocked from the 32 kHz LSI
+ *
+ * Once started it can't be stopped, and resets the MCU unless refresh() is
+ * called within the timeout. It is frozen while the core is halted by the
+ * debugger.
+ */
+class Watchdog {
+public:
+    /** Start with a timeout of up to 8 s, at 8 ms resolution */
+    static void start(uint32_t timeoutMs) {
+        DBGMCU->APB1FZR1 |= DBGMCU_APB1FZR1_DBG_IWDG_STOP;
+
+        uint32_t reload = timeoutMs * LsiHz / 256 / 1000;
+        if(reload > 0xfff) {
+            reload = 0xfff;
+        }
+
+        IWDG->KR = 0xCCCC;
+        IWDG->KR = 0x5555;
+        // Divide by 256
+        IWDG->PR = 6;
+        IWDG->RLR = reload;
+        while(IWDG->SR != 0) {}
+        IWDG->KR = 0xAAAA;
+    }
+
+    static void refresh() {
+        IWDG->KR = 0xAAAA;
+    }
+
+    /** True if the last reset was by the watchdog. Clears the reset flags. */
+    static bool causedReset() {
+        bool watchdog = RCC->CSR & RCC_CSR_IWDGRSTF;
+        RCC->CSR |= RCC_CSR_RMVF;
+        return watchdog;
+    }
+
+private:
+    static const uint32_t LsiHz = 32000;
+};
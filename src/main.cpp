@@ -8,12 +8,30 @@
 
 #include "AnalogFrequencyCounter.hpp"
 #include "DigitalFrequencyCounter.hpp"
+#include "DShot.hpp"
 #include "MotorControl.hpp"
 #include "MovingAverage.hpp"
+#include "Placement.hpp"
+#include "Recipe.hpp"
+#include "RemoteProtocol.hpp"
+#include "Scheduler.hpp"
+#include "SpeedSupervisor.hpp"
+#include "SpeedTrim.hpp"
+#include "Stspin.hpp"
+#include "StepResponse.hpp"
+#include "TachCapture.hpp"
+#include "UartDmaRx.hpp"
+#include "Watchdog.hpp"
 #include "xpt2046.hpp"
-#include "ui/UiManager.hpp"
-#include "ui/Numeric.hpp"
-#include "ui/ImageButton.hpp"
+#ifdef RUN_BENCHMARKS
+#include "Benchmarks.hpp"
+#include "ui/CountingCanvas.hpp"
+#endif
+#include "settings/SettingsStore.hpp"
+#include "settings/Stm32FlashBackend.hpp"
+#include "ui/BandRenderer.hpp"
+#include "ui/PageManager.hpp"
+#include "ui/StaticLayout.hpp"
 #include "ui/images/up_arrow.hpp"
 #include "ui/images/down_arrow.hpp"
 #include "ui/images/play.hpp"
@@ -27,6 +45,31 @@ using namespace modm::platform;
 // 2) If PWM_ESC_CONTROL is not defined, the control line is connected to
 //#define PWM_ESC_CONTROL
 
+// With PWM_ESC_CONTROL, define DSHOT_ESC_CONTROL as 150, 300 or 600 to drive a
+// DShot capable ESC with DShot frames at that rate instead of servo PWM. A
+// frame is sent right away on every control loop update.
+//#define DSHOT_ESC_CONTROL 600
+
+// Without PWM_ESC_CONTROL, define STSPIN_SPEED_TRIM to correct the speed
+// command sent to the STSPIN controller from the tach, e.g. for slip or a
+// wrong pole pair count. See SpeedTrim.hpp.
+//#define STSPIN_SPEED_TRIM
+
+// Define TACH_BLOCK_ESTIMATOR to measure the tach period by autocorrelation
+// over blocks of samples, instead of with the edge detector. It is slower to
+// respond, but holds up on noisy signals where the edge detector chatters.
+//#define TACH_BLOCK_ESTIMATOR
+
+// Define REFERENCE_TACH to measure a second optical sensor on PA1, e.g. a
+// reference, alongside the spindle tach. Its speed is read with the REF
+// remote command.
+//#define REFERENCE_TACH
+
+// Define RUN_BENCHMARKS to build a firmware which times the hot code paths at
+// boot, prints the results as JSON on the ST-Link virtual COM port, and then
+// halts without ever starting the motor. See tools/bench.py.
+//#define RUN_BENCHMARKS
+
 namespace display {
     using Spi = SpiMaster1;
     using Cs = GpioB0;
@@ -54,6 +97,8 @@ namespace motor {
 #else
 namespace motor {
     using Uart = Usart1;
+    // modm:platform:uart:1:buffer.tx in project.xml
+    const uint32_t TxBufferSize = 64;
     using Pin = GpioA9;
     typedef Pin::Tx<modm::platform::Peripheral::Usart1> ConnectType;
 }
@@ -69,69 +114,469 @@ modm::Ili9341Spi<
 Xpt2046<touchpins::Spi, touchpins::Cs, touchpins::Int> touch;
 
 #ifdef PWM_ESC_CONTROL
-modm::PeriodicTimer motorTimer{0.02s};
+static const uint32_t MotorPeriodUs = 20000;
 #else
-modm::PeriodicTimer motorTimer{0.1s};
+static const uint32_t MotorPeriodUs = 100000;
 #endif
-modm::PeriodicTimer touchTimer{0.005s};
+static const uint32_t TouchPeriodUs = 5000;
+// The ADC ISR buffers 256 samples at 1 kHz, so the tach task has plenty of
+// slack; it just has to run before the buffer fills
+static const uint32_t TachPeriodUs = 10000;
+static const uint32_t SettingsPeriodUs = 50000;
 
-ui::UiManager uiManager(&tft);
-ui::NumericActiveDigit<4> settingNumeric(20, 30, modm::glcd::Color::navy(), modm::glcd::Color::maroon());
-ui::Numeric<4> actualNumeric(20, 150, modm::glcd::Color::black());
-ui::ImageButton upButton(210, 0, modm::accessor::asFlash(images::up_arrow), 10);
-ui::ImageButton downButton(210, 60, modm::accessor::asFlash(images::down_arrow), 10);
-ui::ImageButton playButton(210, 140, modm::accessor::asFlash(images::play), 10);
-ui::ImageButton stopButton(210, 140, modm::accessor::asFlash(images::stop), 10);
+Scheduler<8> scheduler;
+Scheduler<8>::TaskId controlTaskId;
+Scheduler<8>::TaskId uiTaskId;
 
 uint16_t rpmSetting = 1000;
 MotorControl motorControl;
 bool motorEnable = false;
+// Speed currently commanded to the motor
+uint16_t activeSetpoint = 0;
 
-void BuildUi() {
-    uiManager.addWidget(&settingNumeric);
-    uiManager.addWidget(&actualNumeric);
-    uiManager.addWidget(&upButton);
-    uiManager.addWidget(&downButton);
-    uiManager.addWidget(&playButton);
-    uiManager.addWidget(&stopButton);
-
-    stopButton.hide();
-
-    upButton.registerClick([]() {
-        uint16_t increment = std::pow(10, 3 - settingNumeric.getActiveDigit());
-        rpmSetting += increment;
-        settingNumeric.setValue(rpmSetting);
-    });
+#ifndef PWM_ESC_CONTROL
+// IDs of the STSPIN controllers on the motor UART. Channel 0 is the spindle,
+// which runs from the main page and is measured by the tach. Channel 1 is an
+// auxiliary motor, e.g. a second spindle or a dispense pump, with its own page.
+// Commands for all channels go out together on every control period.
+static const uint16_t MotorIds[] = {0, 1};
+static const uint8_t NumMotors = sizeof(MotorIds) / sizeof(MotorIds[0]);
+static const uint8_t AuxChannel = 1;
+static_assert(NumMotors > AuxChannel, "The AUX page needs a second channel");
+stspin::Bus<motor::Uart, NumMotors, motor::TxBufferSize> motorBus(MotorIds);
 
-    downButton.registerClick([]() {
-        uint16_t increment = std::pow(10, 3 - settingNumeric.getActiveDigit());
-        rpmSetting -= increment;
-        settingNumeric.setValue(rpmSetting);
-    });
+uint16_t auxSetting = 1000;
+bool auxEnable = false;
 
-    playButton.registerClick([]() {
-        playButton.hide();
-        stopButton.show();
-        motorEnable = true;
-    });
+#ifdef STSPIN_SPEED_TRIM
+// Trims the spindle command by up to 25%, moving it by at most 2% per second,
+// once the setpoint has been steady for 2 s
+SpeedTrim speedTrim({
+    0.5f,   // Gain, per second
+    250,    // Trim limit, per mille
+    20,     // Trim rate limit, per mille per second
+    2000    // Settling time after a setpoint change
+});
+#endif
+#endif
 
-    stopButton.registerClick([]() {
-        stopButton.hide();
-        playButton.show();
-        motorEnable = false;
-    });
+// The step test steps through these speeds, holding each one for
+// StepTestHoldMs, and measures the response. See StepResponse.hpp.
+static const uint16_t StepTestSpeeds[] = {1000, 2000, 3000, 1500};
+static const uint32_t StepTestHoldMs = 8000;
+StepTest<4> stepTest;
+bool stepReportPending = false;
+
+// Step test results, and replies to remote commands, go out on the ST-Link
+// virtual COM port. Output is dropped rather than waited for if the transmit
+// buffer is full, so that it can't hold up the control task.
+modm::IODeviceWrapper<Board::stlink::Uart, modm::IOBuffer::DiscardIfFull> vcpDevice;
+modm::IOStream vcp(vcpDevice);
+
+// Remote commands are received on the virtual COM port by DMA, and parsed in
+// place in the receive ring. See the README for the commands.
+using vcpRx = Usart2DmaRx<256>;
+remote::LineReader<256, 64> remoteReader(vcpRx::buffer());
+static const uint32_t RemotePeriodUs = 10000;
+Recipe<8> recipe;
+// Set when a recipe ends by itself, so that the UI can show it stopped
+bool recipeFinished = false;
+uint32_t telemetryPeriodMs = 0;
+uint32_t telemetryElapsedMs = 0;
+// Raw tach samples can be streamed on the port, and recorded ones fed back
+// in, for checking the edge detector against real signals. See the README.
+TachCapture<Board::stlink::Uart, 512, 32> tachCapture;
+bool replaying = false;
+// Samples per replay command, so that a command fits in a line
+static const uint32_t MaxReplaySamples = 10;
+
+// Stops the motors on tach loss, failure to spin up, or overspeed. Checked
+// by the tach task, so a fault is caught within one tach period of its
+// timeout. See SpeedSupervisor.hpp.
+SpeedSupervisor speedSupervisor({
+    3,      // Tach loss after 3 revolution periods with no edge,
+    30,     // but no sooner than 30 ms,
+    900,    // and no later than 900 ms, however slow the motor
+    10000,  // Time allowed to reach half the setpoint
+    11000,  // Absolute overspeed limit
+    500,    // Overspeed margin above the setpoint,
+    1000,   // for this long
+    2000    // Expected deceleration after the setpoint is lowered, in RPM/s
+});
+// Set by the tach task when the supervisor trips, for the UI task to show
+bool faultPending = false;
+// The control task refreshes the watchdog, so it resets the MCU if the
+// control task stops running. Tasks aren't preempted, so the timeout must be
+// well above the longest a task can hold up the control task: a page switch
+// drawn in one pass, up to a full screen redraw of about 0.55 s without a
+// band budget. The LSI may run up to 6% fast, which still leaves 0.94 s.
+static const uint32_t WatchdogTimeoutMs = 1000;
+
+// Settings are kept in the last two flash pages
+using SettingsFlash = settings::Stm32FlashBackend<2>;
+settings::SettingsStore<SettingsFlash> settingsStore;
+
+// Pages are laid out at compile time. Only the element state (values, active
+// digit, visibility) is kept in RAM.
+void onUpClick();
+void onDownClick();
+void onPlayClick();
+void onStopClick();
+void onDiagnosticsClick();
+void onTrendClick();
+void onStepTestClick();
+void onAuxClick();
+void onAuxUpClick();
+void onAuxDownClick();
+void onAuxPlayClick();
+void onAuxStopClick();
+void onStepRunClick();
+void onStepAbortClick();
+void onBackClick();
+
+namespace colors {
+    // RGB565 values of the modm::glcd::Color presets
+    const uint16_t Black = 0x0000;
+    const uint16_t Navy = 0x000f;
+    const uint16_t Maroon = 0x7800;
+    const uint16_t Red = 0xf800;
+}
+
+namespace labels {
+    constexpr char Diagnostics[] = "DIAG";
+    constexpr char Trend[] = "TREND";
+    constexpr char Step[] = "STEP";
+    constexpr char Aux[] = "AUX";
+    constexpr char AuxTitle[] = "AUX MOTOR";
+    constexpr char Run[] = "RUN";
+    constexpr char Abort[] = "ABORT";
+    constexpr char StepRpm[] = "RPM";
+    constexpr char StepRise[] = "RISE .1s";
+    constexpr char StepOvershoot[] = "OVER %";
+    constexpr char StepSettle[] = "SETL .1s";
+    constexpr char StepRipple[] = "RIPPLE";
+    constexpr char Back[] = "BACK";
+    constexpr char TachOverruns[] = "Tach overruns";
+    constexpr char TachBufferPeak[] = "Tach buffer peak";
+    constexpr char ControlMaxUs[] = "Control max (us)";
+    constexpr char ControlMisses[] = "Control deadline misses";
+    constexpr char PageSwitchMs[] = "Page switch max (ms)";
+    constexpr char TrendBytes[] = "Trend update (bytes)";
+    constexpr char FaultTachLoss[] = "TACH LOST - STOPPED";
+    constexpr char FaultSpinUp[] = "NO SPIN-UP - STOPPED";
+    constexpr char FaultOverspeed[] = "OVERSPEED - STOPPED";
+    constexpr char WatchdogReset[] = "WATCHDOG RESET";
+    constexpr char Vibration[] = "VIBRATION";
+}
+
+// Main page: RPM setting and measured RPM, with motor controls
+using SettingNumeric = ui::NumericElement<20, 30, 4, colors::Navy, colors::Maroon>;
+using ActualNumeric = ui::NumericElement<20, 150, 4, colors::Black>;
+using UpButton = ui::ImageButtonElement<210, 0, images::up_arrow, 10, onUpClick>;
+using DownButton = ui::ImageButtonElement<210, 60, images::down_arrow, 10, onDownClick>;
+using PlayButton = ui::ImageButtonElement<210, 140, images::play, 10, onPlayClick>;
+using StopButton = ui::ImageButtonElement<210, 140, images::stop, 10, onStopClick>;
+using DiagnosticsButton = ui::TextButtonElement<20, 212, 60, 24, labels::Diagnostics, colors::Black, onDiagnosticsClick>;
+using TrendButton = ui::TextButtonElement<90, 212, 60, 24, labels::Trend, colors::Black, onTrendClick>;
+using StepTestButton = ui::TextButtonElement<160, 212, 60, 24, labels::Step, colors::Black, onStepTestClick>;
+using AuxButton = ui::TextButtonElement<230, 212, 60, 24, labels::Aux, colors::Black, onAuxClick>;
+// Only one of these is shown at a time, above the setting
+using TachLossLabel = ui::LabelElement<20, 10, labels::FaultTachLoss, colors::Red>;
+using SpinUpLabel = ui::LabelElement<20, 10, labels::FaultSpinUp, colors::Red>;
+using OverspeedLabel = ui::LabelElement<20, 10, labels::FaultOverspeed, colors::Red>;
+using WatchdogLabel = ui::LabelElement<20, 10, labels::WatchdogReset, colors::Red>;
+// Shown while the tach period jitter is over its limits
+using VibrationLabel = ui::LabelElement<150, 10, labels::Vibration, colors::Maroon>;
+
+ui::StaticPage<
+    SettingNumeric,
+    ActualNumeric,
+    UpButton,
+    DownButton,
+    PlayButton,
+    StopButton,
+    DiagnosticsButton,
+    TrendButton,
+    StepTestButton,
+    TachLossLabel,
+    SpinUpLabel,
+    OverspeedLabel,
+    WatchdogLabel,
+    VibrationLabel
+#ifndef PWM_ESC_CONTROL
+    , AuxButton
+#endif
+> mainPage;
+
+// Diagnostics page: one row per counter, label on the left, value on the right
+template<int16_t Row, const char *Label>
+using DiagnosticsLabel = ui::LabelElement<20, 12 + 36 * Row, Label, colors::Black>;
+template<int16_t Row>
+using DiagnosticsValue = ui::NumericElement<220, 36 * Row, 4, colors::Navy, colors::Navy, ui::SmallDigits>;
+
+using BackButton = ui::TextButtonElement<20, 212, 60, 24, labels::Back, colors::Black, onBackClick>;
+
+#ifndef PWM_ESC_CONTROL
+// Aux page: setting and start/stop of the auxiliary STSPIN channel, laid out
+// like the main page
+using AuxTitle = ui::LabelElement<20, 10, labels::AuxTitle, colors::Black>;
+using AuxSettingNumeric = ui::NumericElement<20, 30, 4, colors::Navy, colors::Maroon>;
+using AuxUpButton = ui::ImageButtonElement<210, 0, images::up_arrow, 10, onAuxUpClick>;
+using AuxDownButton = ui::ImageButtonElement<210, 60, images::down_arrow, 10, onAuxDownClick>;
+using AuxPlayButton = ui::ImageButtonElement<210, 140, images::play, 10, onAuxPlayClick>;
+using AuxStopButton = ui::ImageButtonElement<210, 140, images::stop, 10, onAuxStopClick>;
+
+ui::StaticPage<
+    AuxTitle,
+    AuxSettingNumeric,
+    AuxUpButton,
+    AuxDownButton,
+    AuxPlayButton,
+    AuxStopButton,
+    BackButton
+> auxPage;
+#endif
+
+ui::StaticPage<
+    DiagnosticsLabel<0, labels::TachOverruns>, DiagnosticsValue<0>,
+    DiagnosticsLabel<1, labels::TachBufferPeak>, DiagnosticsValue<1>,
+    DiagnosticsLabel<2, labels::ControlMaxUs>, DiagnosticsValue<2>,
+    DiagnosticsLabel<3, labels::ControlMisses>, DiagnosticsValue<3>,
+    DiagnosticsLabel<4, labels::PageSwitchMs>, DiagnosticsValue<4>,
+    DiagnosticsLabel<5, labels::TrendBytes>, DiagnosticsValue<5>,
+    BackButton
+> diagnosticsPage;
+
+// Trend page: setpoint and measured RPM over the last 300 control periods,
+// i.e. 30 s with the STSPIN controller
+using TrendChart = ui::TrendChartElement<10, 10, 300, 190, colors::Red, colors::Navy>;
+
+ui::StaticPage<
+    TrendChart,
+    BackButton
+> trendPage;
+
+// Step test page: one row of results per step, times in 0.1 s
+template<int16_t Left, const char *Label>
+using StepHeader = ui::LabelElement<Left, 8, Label, colors::Black>;
+template<uint8_t Step>
+using StepTarget = ui::NumericElement<8, 24 + 40 * Step, 4, colors::Navy, colors::Navy, ui::SmallDigits>;
+template<int16_t Left, uint8_t Step>
+using StepValue = ui::NumericElement<Left, 24 + 40 * Step, 3, colors::Black, colors::Black, ui::SmallDigits>;
+
+using StepRunButton = ui::TextButtonElement<90, 212, 60, 24, labels::Run, colors::Black, onStepRunClick>;
+using StepAbortButton = ui::TextButtonElement<160, 212, 60, 24, labels::Abort, colors::Black, onStepAbortClick>;
+
+ui::StaticPage<
+    StepHeader<8, labels::StepRpm>,
+    StepHeader<84, labels::StepRise>,
+    StepHeader<144, labels::StepOvershoot>,
+    StepHeader<204, labels::StepSettle>,
+    StepHeader<264, labels::StepRipple>,
+    StepTarget<0>, StepValue<84, 0>, StepValue<144, 0>, StepValue<204, 0>, StepValue<264, 0>,
+    StepTarget<1>, StepValue<84, 1>, StepValue<144, 1>, StepValue<204, 1>, StepValue<264, 1>,
+    StepTarget<2>, StepValue<84, 2>, StepValue<144, 2>, StepValue<204, 2>, StepValue<264, 2>,
+    StepTarget<3>, StepValue<84, 3>, StepValue<144, 3>, StepValue<204, 3>, StepValue<264, 3>,
+    BackButton,
+    StepRunButton,
+    StepAbortButton
+> stepTestPage;
+
+ui::PageManager pages;
+
+// Elements are composed in a 320x16 pixel band in RAM (10 KiB), and each band
+// goes to the display in a single transfer
+ui::BandRenderer<decltype(tft), 320 * 16> bandRenderer(&tft);
+
+void onUpClick() {
+    auto setting = mainPage.get<SettingNumeric>();
+    uint16_t increment = std::pow(10, 3 - setting.getActiveDigit());
+    rpmSetting += increment;
+    setting.setValue(rpmSetting);
+}
+
+void onDownClick() {
+    auto setting = mainPage.get<SettingNumeric>();
+    uint16_t increment = std::pow(10, 3 - setting.getActiveDigit());
+    rpmSetting -= increment;
+    setting.setValue(rpmSetting);
+}
+
+void clearFault() {
+    speedSupervisor.clear();
+    mainPage.get<TachLossLabel>().hide();
+    mainPage.get<SpinUpLabel>().hide();
+    mainPage.get<OverspeedLabel>().hide();
+    mainPage.get<WatchdogLabel>().hide();
+    mainPage.get<VibrationLabel>().hide();
+}
+
+void onPlayClick() {
+    // The tach is showing a recording, or the step test has the motor
+    if(replaying || stepTest.isRunning()) {
+        return;
+    }
+    clearFault();
+    mainPage.get<PlayButton>().hide();
+    mainPage.get<StopButton>().show();
+    motorEnable = true;
+    // The trend shows one run at a time
+    trendPage.get<TrendChart>().clear();
+    // Only persist the setting once a run is started, rather than on every
+    // button press, to save flash wear
+    settingsStore.set(settings::Key::RpmSetting, rpmSetting);
+}
+
+void onStopClick() {
+    mainPage.get<StopButton>().hide();
+    mainPage.get<PlayButton>().show();
+    motorEnable = false;
+    stepTest.abort();
+    recipe.stop();
+}
+
+void updateDiagnostics();
+
+void onDiagnosticsClick() {
+    // The page isn't tracking changes yet, so this costs no drawing, and it is
+    // shown with current values
+    updateDiagnostics();
+    pages.show(&diagnosticsPage);
+}
+
+void onTrendClick() {
+    pages.show(&trendPage);
+}
+
+void onStepTestClick() {
+    pages.show(&stepTestPage);
+}
+
+void onStepRunClick() {
+    // Not while the motor is running from the main page or a recipe
+    if(motorEnable || stepTest.isRunning() || recipe.isRunning() || replaying) {
+        return;
+    }
+    clearFault();
+    stepTest.start(StepTestSpeeds, sizeof(StepTestSpeeds) / sizeof(StepTestSpeeds[0]), MotorPeriodUs / 1000, StepTestHoldMs);
+    trendPage.get<TrendChart>().clear();
+}
+
+void onStepAbortClick() {
+    stepTest.abort();
+}
+
+#ifndef PWM_ESC_CONTROL
+void onAuxClick() {
+    pages.show(&auxPage);
+}
+
+void onAuxUpClick() {
+    auto setting = auxPage.get<AuxSettingNumeric>();
+    auxSetting += std::pow(10, 3 - setting.getActiveDigit());
+    setting.setValue(auxSetting);
+}
+
+void onAuxDownClick() {
+    auto setting = auxPage.get<AuxSettingNumeric>();
+    auxSetting -= std::pow(10, 3 - setting.getActiveDigit());
+    setting.setValue(auxSetting);
+}
+
+void onAuxPlayClick() {
+    auxPage.get<AuxPlayButton>().hide();
+    auxPage.get<AuxStopButton>().show();
+    auxEnable = true;
 }
 
+void onAuxStopClick() {
+    auxPage.get<AuxStopButton>().hide();
+    auxPage.get<AuxPlayButton>().show();
+    auxEnable = false;
+}
+#endif
+
+void onBackClick() {
+    pages.show(&mainPage);
+}
+
+void BuildUi() {
+    mainPage.get<StopButton>().hide();
+    mainPage.get<TachLossLabel>().hide();
+    mainPage.get<SpinUpLabel>().hide();
+    mainPage.get<OverspeedLabel>().hide();
+    mainPage.get<WatchdogLabel>().hide();
+    mainPage.get<VibrationLabel>().hide();
+    mainPage.get<SettingNumeric>().setValue(rpmSetting);
+    mainPage.get<SettingNumeric>().setActiveDigit(1);
+#ifndef PWM_ESC_CONTROL
+    auxPage.get<AuxStopButton>().hide();
+    auxPage.get<AuxSettingNumeric>().setValue(auxSetting);
+    auxPage.get<AuxSettingNumeric>().setActiveDigit(1);
+#endif
+    pages.show(&mainPage);
+}
+
+// Touch calibration, loaded from the settings store at boot. These are the
+// defaults used when nothing is stored.
 namespace touchCalibration {
-    const uint16_t MinX = 390;
-    const uint16_t MinY = 360;
-    const uint16_t MaxX = 3880;
-    const uint16_t MaxY = 3800;
+    uint16_t MinX = 390;
+    uint16_t MinY = 360;
+    uint16_t MaxX = 3880;
+    uint16_t MaxY = 3800;
 };
 
-using freqCounter = AnalogFrequencyCounter<Timer2, Board::SystemClock>;
+// Number of electrical revolutions per mechanical revolution of the motor
+uint8_t motorPolePairs = 7;
+
+void loadSettings() {
+    settingsStore.initialize();
+    rpmSetting = settingsStore.getOr(settings::Key::RpmSetting, rpmSetting);
+    touchCalibration::MinX = settingsStore.getOr(settings::Key::TouchMinX, touchCalibration::MinX);
+    touchCalibration::MinY = settingsStore.getOr(settings::Key::TouchMinY, touchCalibration::MinY);
+    touchCalibration::MaxX = settingsStore.getOr(settings::Key::TouchMaxX, touchCalibration::MaxX);
+    touchCalibration::MaxY = settingsStore.getOr(settings::Key::TouchMaxY, touchCalibration::MaxY);
+    motorPolePairs = settingsStore.getOr(settings::Key::MotorPolePairs, motorPolePairs);
+    motorControl.setGains(
+        settingsStore.getOr(settings::Key::Kp, MotorControl::DefaultKp),
+        settingsStore.getOr(settings::Key::Ki, MotorControl::DefaultKi),
+        settingsStore.getOr(settings::Key::Kd, MotorControl::DefaultKd)
+    );
+}
+
+using Tach = AnalogFrequencyCounter<DefaultTachConfig>;
+// The sample buffer and edge detector state are used by the ADC ISR and the
+// edge detector on every sample
+HOT_DATA Tach tach;
+
+#ifdef REFERENCE_TACH
+// Second optical sensor on PA1, read by ADC2 at the same rate as the spindle
+// tach
+struct ReferenceTachConfig : DefaultTachConfig {
+    using Adc = modm::platform::Adc2;
+    using Pin = GpioA1::In2;
+    static constexpr Adc::Channel Channel = Adc::Channel::Channel2;
+};
+HOT_DATA AnalogFrequencyCounter<ReferenceTachConfig> referenceTach;
+#endif
 
 #ifdef PWM_ESC_CONTROL
+#ifdef DSHOT_ESC_CONTROL
+using escOutput = dshot::Tim1Ch2Output<Board::SystemClock::Timer1, DSHOT_ESC_CONTROL>;
+
+void setupPwm() {
+    motor::ConnectType::connect();
+    escOutput::initialize();
+}
+
+void setPulseWidth(uint32_t width_us) {
+    escOutput::send(dshot::throttleFromPulseWidth(width_us));
+}
+
+#else
+// Timer ticks per millisecond, set once the timer is configured
+uint32_t pwmTicksPerMs = 0;
+
 void setupPwm() {
     motor::Pin::setOutput(true);
     motor::Timer::enable();
@@ -153,60 +598,718 @@ void setupPwm() {
     motor::Timer::start();
 
     //motor::Timer::setNormalPwm(motor::Chan);
-}
 
-void setPulseWidth(uint32_t width_us) {
     // modm advanced timer (i.e. timer1) doesn't have getTickFrequency, so hacking
     // some local assumptions here instead
-    float cycles = Board::SystemClock::Timer1 / (TIM1->PSC + 1) * (float)width_us / 1e6f;
-    //float cycles = (float)motor::Timer::getTickFrequency<Board::SystemClock>() * (float)width_us / 1e6f;
+    pwmTicksPerMs = Board::SystemClock::Timer1 / (TIM1->PSC + 1) / 1000;
+}
 
-    motor::Timer::setCompareValue(motor::Chan, (uint16_t)(cycles + 0.5));
+void setPulseWidth(uint32_t width_us) {
+    uint32_t cycles = (pwmTicksPerMs * width_us + 500) / 1000;
+    motor::Timer::setCompareValue(motor::Chan, (uint16_t)cycles);
     motor::Timer::applyAndReset();
 }
+#endif
 
 #endif
 
-MODM_ISR(TIM2)
+// Cycles from the TIM2 update event to the first instruction of its ISR,
+// i.e. interrupt latency, including time spent with interrupts masked
+uint32_t tim2LatencyMin = UINT32_MAX;
+uint32_t tim2LatencyMax = 0;
+
+MODM_ISR(TIM2, HOT_CODE)
 {
-    freqCounter::isrHandler();
-}
-
-/** Send RPM command to an STSPIN motor controller via UART */
-template<class UsartType>
-void send_rpm_command(uint32_t rpm) {
-    // Scale RPM to the units used by the motor controller, which are
-    // electrical rev/s times 100
-    // 7 electrical revs per mechanical rev (property of motor)
-    // 60 RPM per RPS
-    // 100 scale factor for units
-    uint32_t scaled_electrical_rps = rpm * 7 * 100 / 60;
-
-    // Really hacky message serializer lives here.
-    uint8_t buf[11];
-    // Sync bytes
-    buf[0] = 2;
-    buf[1] = 3;
-    // ID
-    buf[2] = 0;
-    buf[3] = 0;
-    // length
-    buf[4] = 4;
-    // Data
-    *((uint32_t *)&buf[5]) = scaled_electrical_rps;
-    // checksum
-    buf[9] = 0;
-    buf[10] = 0;
-    for(uint32_t i=0; i<9; i++) {
-        buf[9] += buf[i];
-        buf[10] += buf[9];
-    }
-    UsartType::write(buf, sizeof(buf));
+    // The counter restarted from 0 at the update event
+    uint32_t latency = TIM2->CNT * (TIM2->PSC + 1);
+    if(latency < tim2LatencyMin) {
+        tim2LatencyMin = latency;
+    }
+    if(latency > tim2LatencyMax) {
+        tim2LatencyMax = latency;
+    }
+    Timer2::acknowledgeInterruptFlags(Timer2::getInterruptFlags());
+    tach.startConversion();
+#ifdef REFERENCE_TACH
+    referenceTach.startConversion();
+#endif
+}
+
+MODM_ISR(ADC1_2, HOT_CODE)
+{
+    tach.adcHandler();
+#ifdef REFERENCE_TACH
+    referenceTach.adcHandler();
+#endif
+}
+
+// Raised by reading a settings record torn by a power loss, which the backend
+// repairs. Any other cause is fatal, and the watchdog resets.
+extern "C" void NMI_Handler()
+{
+    if(!SettingsFlash::repairEccError()) {
+        while(true) {}
+    }
+}
+
+// Most recent tach reading, handed from the control task to the UI task
+uint32_t measuredRpm = 0;
+bool newMeasurement = false;
+
+// Time from boot to the first run of the control task, and to the first page
+// being drawn in full; 0 until then
+uint32_t bootControlReadyUs = 0;
+uint32_t bootFirstFrameUs = 0;
+bool displayReady = false;
+
+// The microsecond clock starts with the system clock, in Board::initialize()
+static uint32_t bootTimeUs() {
+    return modm::chrono::micro_clock::now().time_since_epoch().count();
+}
+
+void printBootTimes() {
+    vcp << "BOOT " << bootControlReadyUs << " " << bootFirstFrameUs << modm::endl;
+}
+
+/** Initialize the display controller
+ *
+ * This blocks for the controller's reset and sleep out delays, so it is left
+ * to the UI task, after the control task is up.
+ */
+void initDisplay() {
+    tft.initialize();
+    tft.enableBacklight(true);
+    tft.setRotation(modm::ili9341::Rotation::Rotate90);
+}
+
+/** Stop all motors through the active backend, without waiting for the
+ * control task
+ */
+void safeStop() {
+    motorEnable = false;
+    stepTest.abort();
+    recipe.stop();
+    activeSetpoint = 0;
+#ifdef PWM_ESC_CONTROL
+    motorControl.set_speed(0);
+    setPulseWidth(1000);
+#else
+    auxEnable = false;
+    motorBus.motor(0).setSpeed(0);
+    motorBus.motor(AuxChannel).setSpeed(0);
+    // If a batch is still going out, the control task sends the stop on its
+    // next period
+    motorBus.send();
+#endif
+}
+
+void captureSamples(const uint16_t *samples, uint32_t count) {
+    tachCapture.push(samples, count, tach.getOverruns());
+}
+
+void tachTask() {
+    tach.task();
+#ifdef REFERENCE_TACH
+    referenceTach.task();
+#endif
+
+    // A replayed recording isn't the motor
+    if(replaying || speedSupervisor.getFault() != SpeedSupervisor::Fault::None) {
+        return;
+    }
+    uint32_t rpm = (uint32_t)(60 * tach.getFrequency());
+    auto fault = speedSupervisor.update(activeSetpoint, rpm, tach.getPeriodMs(),
+        tach.getMsSinceLastEdge(), TachPeriodUs / 1000);
+    if(fault != SpeedSupervisor::Fault::None) {
+        safeStop();
+        faultPending = true;
+        scheduler.signal(uiTaskId);
+    }
+}
+
+void controlTask() {
+    Watchdog::refresh();
+    if(bootControlReadyUs == 0) {
+        bootControlReadyUs = bootTimeUs();
+    }
+    uint32_t rpm = (uint32_t)(60 * tach.getFrequency());
+
+    if(speedSupervisor.getFault() != SpeedSupervisor::Fault::None) {
+        activeSetpoint = 0;
+    } else if(stepTest.isRunning()) {
+        activeSetpoint = stepTest.update(rpm);
+        stepReportPending = stepTest.isComplete();
+    } else if(recipe.isRunning()) {
+        activeSetpoint = recipe.update(MotorPeriodUs / 1000);
+        recipeFinished = !recipe.isRunning();
+    } else {
+        activeSetpoint = motorEnable ? rpmSetting : 0;
+    }
+
+#ifdef PWM_ESC_CONTROL
+    motorControl.set_speed(activeSetpoint);
+    float pwm = motorControl.update((float)rpm);
+    setPulseWidth((uint32_t)pwm);
+#else
+#ifdef STSPIN_SPEED_TRIM
+    motorBus.motor(0).setSpeed(speedTrim.update(activeSetpoint, rpm, MotorPeriodUs / 1000));
+#else
+    motorBus.motor(0).setSpeed(activeSetpoint);
+#endif
+    motorBus.motor(AuxChannel).setSpeed(auxEnable ? auxSetting : 0);
+    motorBus.send();
+#endif
+    measuredRpm = rpm;
+    newMeasurement = true;
+    scheduler.signal(uiTaskId);
+}
+
+void touchTask() {
+    int16_t w = tft.getWidth();
+    int16_t h = tft.getHeight();
+    modm::glcd::Point p;
+    bool touch_active = touch.read(&p);
+
+    int16_t px = w - (p.x - touchCalibration::MinX) * w / (touchCalibration::MaxX - touchCalibration::MinX);
+    int16_t py = h - (p.y - touchCalibration::MinY) * h / (touchCalibration::MaxY - touchCalibration::MinY);
+    pages.handleTouchStatus(touch_active, px, py);
+    if(pages.isDirty()) {
+        scheduler.signal(uiTaskId);
+    }
+}
+
+// SPI bytes sent by the last flush of the trend page which wasn't a page switch
+uint32_t trendUpdateBytes = 0;
+
+// Diagnostics values are shown with 4 digits
+static uint16_t clampDiagnostic(uint32_t value) {
+    return value > 9999 ? 9999 : value;
+}
+
+void updateDiagnostics() {
+    const auto &control = scheduler.getStats(controlTaskId);
+    diagnosticsPage.get<DiagnosticsValue<0>>().setValue(clampDiagnostic(tach.getOverruns()));
+    diagnosticsPage.get<DiagnosticsValue<1>>().setValue(clampDiagnostic(tach.getBufferHighWater()));
+    diagnosticsPage.get<DiagnosticsValue<2>>().setValue(clampDiagnostic(control.maxUs));
+    diagnosticsPage.get<DiagnosticsValue<3>>().setValue(clampDiagnostic(control.deadlineMisses));
+    diagnosticsPage.get<DiagnosticsValue<4>>().setValue(clampDiagnostic(pages.getMaxSwitchUs() / 1000));
+    diagnosticsPage.get<DiagnosticsValue<5>>().setValue(clampDiagnostic(trendUpdateBytes));
+}
+
+// Step test values are shown with 3 digits; anything not reached shows as 999
+static uint16_t clampStepValue(uint32_t value) {
+    return value > 999 ? 999 : value;
+}
+
+template<uint8_t Step>
+void showStepResult() {
+    if(Step >= stepTest.getNumSteps()) {
+        return;
+    }
+    const StepResponse::Result &r = stepTest.getResult(Step);
+    stepTestPage.get<StepTarget<Step>>().setValue(r.targetRpm);
+    stepTestPage.get<StepValue<84, Step>>().setValue(clampStepValue(r.riseMs / 100));
+    stepTestPage.get<StepValue<144, Step>>().setValue(clampStepValue(r.overshootPct));
+    stepTestPage.get<StepValue<204, Step>>().setValue(clampStepValue(r.settleMs / 100));
+    stepTestPage.get<StepValue<264, Step>>().setValue(clampStepValue(r.rippleRpm));
+}
+
+static void printStepValue(uint32_t value) {
+    if(value == StepResponse::NotReached) {
+        vcp << "-";
+    } else {
+        vcp << value;
+    }
+}
+
+void reportStepTest() {
+    showStepResult<0>();
+    showStepResult<1>();
+    showStepResult<2>();
+    showStepResult<3>();
+
+    vcp << "step test: control period " << MotorPeriodUs / 1000 << " ms, hold " << StepTestHoldMs << " ms" << modm::endl;
+    vcp << "step,target_rpm,rise_ms,overshoot_pct,settle_ms,ripple_rpm" << modm::endl;
+    for(uint8_t i = 0; i < stepTest.getNumSteps(); i++) {
+        const StepResponse::Result &r = stepTest.getResult(i);
+        vcp << (i + 1) << "," << r.targetRpm << ",";
+        printStepValue(r.riseMs);
+        vcp << "," << r.overshootPct << ",";
+        printStepValue(r.settleMs);
+        vcp << "," << r.rippleRpm << modm::endl;
+    }
+}
+
+void showFault() {
+    SpeedSupervisor::Fault fault = speedSupervisor.getFault();
+    // The motors are already stopped; bring the buttons in line
+    onStopClick();
+#ifndef PWM_ESC_CONTROL
+    onAuxStopClick();
+#endif
+    if(fault == SpeedSupervisor::Fault::TachLoss) {
+        mainPage.get<TachLossLabel>().show();
+    } else if(fault == SpeedSupervisor::Fault::SpinUpTimeout) {
+        mainPage.get<SpinUpLabel>().show();
+    } else {
+        mainPage.get<OverspeedLabel>().show();
+    }
+    vcp << "FAULT " << SpeedSupervisor::faultName(fault) << " " << speedSupervisor.getFaultRpm()
+        << " " << speedSupervisor.getDetectionMs() << modm::endl;
+}
+
+// Jitter results are judged once per block of revolutions, and only if the
+// speed was steady for all of it, as speed changes show up as period
+// variation too
+uint32_t jitterBlocks = 0;
+bool jitterSteady = false;
+
+void printJitter(const char *prefix) {
+    const auto &r = tach.getPeriodAnalytics().getResult();
+    vcp << prefix << (uint32_t)r.mean << " " << (uint32_t)r.stdDev << " " << (uint32_t)r.peakToPeak;
+    for(float h : r.harmonic) {
+        vcp << " " << (uint32_t)h;
+    }
+    vcp << " " << (uint32_t)r.alarms << modm::endl;
+}
+
+void checkJitter() {
+    uint32_t tolerance = activeSetpoint / 20;
+    if(activeSetpoint == 0 || measuredRpm + tolerance < activeSetpoint || measuredRpm > activeSetpoint + tolerance) {
+        jitterSteady = false;
+    }
+
+    const auto &analytics = tach.getPeriodAnalytics();
+    if(analytics.getBlocks() == jitterBlocks) {
+        return;
+    }
+    jitterBlocks = analytics.getBlocks();
+    bool alarm = jitterSteady && analytics.getResult().alarms != 0;
+    jitterSteady = true;
+
+    // Once raised, the alarm stays up until the next run is started
+    auto label = mainPage.get<VibrationLabel>();
+    if(alarm && label.isHidden()) {
+        label.show();
+        printJitter("ALARM JITTER ");
+    }
+}
+
+void uiTask() {
+    if(!displayReady) {
+        initDisplay();
+        displayReady = true;
+    }
+    if(stepReportPending) {
+        stepReportPending = false;
+        reportStepTest();
+    }
+    if(recipeFinished) {
+        recipeFinished = false;
+        onStopClick();
+    }
+    if(faultPending) {
+        faultPending = false;
+        showFault();
+    }
+    mainPage.get<ActualNumeric>().setValue(measuredRpm);
+    checkJitter();
+    if(newMeasurement) {
+        newMeasurement = false;
+        // Scale to 1.5x the setting, in steps of 500 RPM, so that the scale
+        // only changes with the setting
+        auto trend = trendPage.get<TrendChart>();
+        trend.setFullScale((rpmSetting * 3 / 2 + 499) / 500 * 500);
+        trend.push(activeSetpoint, measuredRpm);
+    }
+    // Hidden pages aren't drawn, so only spend time on what is shown
+    if(pages.isShown(&diagnosticsPage)) {
+        updateDiagnostics();
+    }
+
+    bool measureTrend = pages.isShown(&trendPage) && !pages.isSwitching();
+    uint32_t bytesBefore = bandRenderer.getBytesSent();
+    pages.flush(bandRenderer);
+    if(measureTrend && bandRenderer.getBytesSent() != bytesBefore) {
+        trendUpdateBytes = bandRenderer.getBytesSent() - bytesBefore;
+    }
+    if(bootFirstFrameUs == 0 && !pages.isSwitching()) {
+        bootFirstFrameUs = bootTimeUs();
+        printBootTimes();
+        // initDisplay() held up the other tasks once, while the motor was
+        // stopped. That is boot time, reported by BOOT, so the task statistics
+        // start from here.
+        scheduler.clearStats();
+    }
+}
+
+#ifdef RUN_BENCHMARKS
+/** Report the RAM taken by the UI, which is laid out at compile time, so
+ * only element state is kept per page
+ */
+void reportUiMemory(bench::Runner &runner) {
+    runner.memory("mainPage", sizeof(mainPage));
+    runner.memory("diagnosticsPage", sizeof(diagnosticsPage));
+    runner.memory("trendPage", sizeof(trendPage));
+    runner.memory("stepTestPage", sizeof(stepTestPage));
+#ifndef PWM_ESC_CONTROL
+    runner.memory("auxPage", sizeof(auxPage));
+#endif
+    runner.memory("pages", sizeof(pages));
+}
+
+/** Account for the display traffic of a scripted sequence of UI changes
+ *
+ * Frames are composed into a counting canvas rather than sent, starting from
+ * the boot state of the UI. The hashes of the screen after each frame act as
+ * golden frames: tools/bench.py flags any frame after which the screen shows
+ * something else than in the baseline.
+ */
+void runUiFrames(bench::Runner &runner) {
+    static ui::CountingCanvas<320 * 16> canvas(&tft, [](modm::GraphicDisplay *d, const ui::Rect &band) {
+        pages.drawBand(d, band);
+    });
+    canvas.setColor(modm::glcd::Color::red());
+    canvas.setBackgroundColor(modm::glcd::Color::white());
+
+    runner.frame("boot", canvas, []() {
+        rpmSetting = 1000;
+        BuildUi();
+        pages.flush(canvas);
+    });
+    runner.frame("setting_digit", canvas, []() {
+        mainPage.get<SettingNumeric>().setValue(1100);
+        pages.flush(canvas);
+    });
+    runner.frame("active_digit", canvas, []() {
+        mainPage.get<SettingNumeric>().setActiveDigit(2);
+        pages.flush(canvas);
+    });
+    runner.frame("actual_rpm", canvas, []() {
+        mainPage.get<ActualNumeric>().setValue(1234);
+        pages.flush(canvas);
+    });
+    runner.frame("play_stop", canvas, []() {
+        mainPage.get<PlayButton>().hide();
+        mainPage.get<StopButton>().show();
+        pages.flush(canvas);
+    });
+    runner.frame("to_trend", canvas, []() {
+        pages.show(&trendPage);
+        pages.flush(canvas);
+    });
+    runner.frame("trend_sample", canvas, []() {
+        trendPage.get<TrendChart>().push(1100, 1050);
+        pages.flush(canvas);
+    });
+    runner.frame("to_diagnostics", canvas, []() {
+        pages.show(&diagnosticsPage);
+        pages.flush(canvas);
+    });
+    runner.frame("to_main", canvas, []() {
+        pages.show(&mainPage);
+        pages.flush(canvas);
+    });
+}
+#endif
+
+void setRpmSetting(uint16_t rpm) {
+    rpmSetting = rpm;
+    mainPage.get<SettingNumeric>().setValue(rpmSetting);
+}
+
+void handleRecipeCommand(remote::Line &line) {
+    remote::Token t;
+    uint32_t rpm, durationMs;
+    if(!line.next(t)) {
+        vcp << "ERR syntax" << modm::endl;
+    } else if(line.equals(t, "CLEAR") && !line.more()) {
+        // A running recipe is stopped with STOP, not cleared from under it
+        if(recipe.isRunning()) {
+            vcp << "ERR busy" << modm::endl;
+        } else {
+            recipe.clear();
+            vcp << "OK" << modm::endl;
+        }
+    } else if(line.equals(t, "ADD")) {
+        remote::Token rpmToken, durationToken;
+        if(!line.next(rpmToken) || !line.next(durationToken) || line.more() ||
+            !line.toUint(rpmToken, rpm) || !line.toUint(durationToken, durationMs) || rpm > 9999) {
+            vcp << "ERR syntax" << modm::endl;
+        } else if(recipe.isRunning()) {
+            vcp << "ERR busy" << modm::endl;
+        } else if(!recipe.add(rpm, durationMs)) {
+            vcp << "ERR full" << modm::endl;
+        } else {
+            vcp << "OK" << modm::endl;
+        }
+    } else if(line.equals(t, "RUN") && !line.more()) {
+        if(motorEnable || stepTest.isRunning() || recipe.isRunning() || replaying) {
+            vcp << "ERR busy" << modm::endl;
+        } else if(recipe.getNumSteps() == 0) {
+            vcp << "ERR empty" << modm::endl;
+        } else {
+            clearFault();
+            recipe.start();
+            mainPage.get<PlayButton>().hide();
+            mainPage.get<StopButton>().show();
+            trendPage.get<TrendChart>().clear();
+            vcp << "OK" << modm::endl;
+        }
+    } else {
+        vcp << "ERR syntax" << modm::endl;
+    }
+}
+
+// Touch calibration, in raw touch controller counts: CAL <min x> <min y>
+// <max x> <max y> sets and stores it, CAL alone reads it back
+void handleCalibrationCommand(remote::Line &line) {
+    if(!line.more()) {
+        vcp << "CAL " << touchCalibration::MinX << " " << touchCalibration::MinY << " " <<
+            touchCalibration::MaxX << " " << touchCalibration::MaxY << modm::endl;
+        return;
+    }
+    remote::Token tokens[4];
+    uint32_t values[4];
+    for(uint32_t i = 0; i < 4; i++) {
+        if(!line.next(tokens[i]) || !line.toUint(tokens[i], values[i]) || values[i] > 4095) {
+            vcp << "ERR syntax" << modm::endl;
+            return;
+        }
+    }
+    if(line.more() || values[0] >= values[2] || values[1] >= values[3]) {
+        vcp << "ERR syntax" << modm::endl;
+        return;
+    }
+    touchCalibration::MinX = values[0];
+    touchCalibration::MinY = values[1];
+    touchCalibration::MaxX = values[2];
+    touchCalibration::MaxY = values[3];
+    bool stored = settingsStore.set(settings::Key::TouchMinX, touchCalibration::MinX) &&
+        settingsStore.set(settings::Key::TouchMinY, touchCalibration::MinY) &&
+        settingsStore.set(settings::Key::TouchMaxX, touchCalibration::MaxX) &&
+        settingsStore.set(settings::Key::TouchMaxY, touchCalibration::MaxY);
+    vcp << (stored ? "OK" : "ERR flash") << modm::endl;
+}
+
+// POLES <n> sets and stores the motor pole pairs, POLES alone reads them back
+void handlePolePairsCommand(remote::Line &line) {
+    if(!line.more()) {
+        vcp << "POLES " << (uint32_t)motorPolePairs << modm::endl;
+        return;
+    }
+    remote::Token t;
+    uint32_t value;
+    if(!line.next(t) || line.more() || !line.toUint(t, value) || value == 0 || value > 255) {
+        vcp << "ERR syntax" << modm::endl;
+    } else if(motorEnable || stepTest.isRunning() || recipe.isRunning()) {
+        // The commanded speed would jump
+        vcp << "ERR busy" << modm::endl;
+    } else {
+        motorPolePairs = value;
+#ifndef PWM_ESC_CONTROL
+        motorBus.motor(0).setPolePairs(motorPolePairs);
+#endif
+        bool stored = settingsStore.set(settings::Key::MotorPolePairs, motorPolePairs);
+        vcp << (stored ? "OK" : "ERR flash") << modm::endl;
+    }
+}
+
+// Speed controller gains, in thousandths: PID <kp> <ki> <kd> sets and stores
+// them, PID alone reads them back
+void handleGainsCommand(remote::Line &line) {
+    if(!line.more()) {
+        vcp << "PID " << (uint32_t)(motorControl.getKp() * 1000.0f + 0.5f) << " " <<
+            (uint32_t)(motorControl.getKi() * 1000.0f + 0.5f) << " " <<
+            (uint32_t)(motorControl.getKd() * 1000.0f + 0.5f) << modm::endl;
+        return;
+    }
+    remote::Token tokens[3];
+    uint32_t values[3];
+    for(uint32_t i = 0; i < 3; i++) {
+        if(!line.next(tokens[i]) || !line.toUint(tokens[i], values[i])) {
+            vcp << "ERR syntax" << modm::endl;
+            return;
+        }
+    }
+    if(line.more()) {
+        vcp << "ERR syntax" << modm::endl;
+        return;
+    }
+    float kp = values[0] / 1000.0f;
+    float ki = values[1] / 1000.0f;
+    float kd = values[2] / 1000.0f;
+    motorControl.setGains(kp, ki, kd);
+    bool stored = settingsStore.set(settings::Key::Kp, kp) &&
+        settingsStore.set(settings::Key::Ki, ki) &&
+        settingsStore.set(settings::Key::Kd, kd);
+    vcp << (stored ? "OK" : "ERR flash") << modm::endl;
+}
+
+void handleCaptureCommand(remote::Line &line) {
+    remote::Token t;
+    if(!line.next(t) || line.more()) {
+        vcp << "ERR syntax" << modm::endl;
+    } else if(line.equals(t, "ON")) {
+        // Reply first, so it comes before the first packet
+        vcp << "OK" << modm::endl;
+        tachCapture.start();
+    } else if(line.equals(t, "OFF")) {
+        tachCapture.stop();
+        vcp << "CAPTURE " << tachCapture.getSent() << " " << tachCapture.getDropped() << modm::endl;
+    } else {
+        vcp << "ERR syntax" << modm::endl;
+    }
+}
+
+void handleReplayCommand(remote::Line &line) {
+    remote::Token t;
+    if(!line.next(t) || line.more()) {
+        vcp << "ERR syntax" << modm::endl;
+    } else if(line.equals(t, "ON")) {
+        // Recorded samples must not spin the motor
+        if(motorEnable || stepTest.isRunning() || recipe.isRunning()) {
+            vcp << "ERR busy" << modm::endl;
+        } else {
+            replaying = true;
+            // The ADC keeps converting, and with REFERENCE_TACH the ADC1_2
+            // vector still fires for ADC2; setReplay() makes the handler drop
+            // the live samples, so the S commands are the only producer
+            tach.setReplay(true);
+            vcp << "OK" << modm::endl;
+        }
+    } else if(line.equals(t, "OFF")) {
+        replaying = false;
+        tach.setReplay(false);
+        vcp << "OK" << modm::endl;
+    } else {
+        vcp << "ERR syntax" << modm::endl;
+    }
+}
+
+void handleSamplesCommand(remote::Line &line) {
+    if(!replaying) {
+        vcp << "ERR busy" << modm::endl;
+        return;
+    }
+    // Check all of them before queueing any, so that a bad line is all or nothing
+    uint16_t samples[MaxReplaySamples];
+    uint32_t count = 0;
+    remote::Token t;
+    uint32_t value;
+    while(line.next(t)) {
+        if(count == MaxReplaySamples || !line.toUint(t, value) || value > 4095) {
+            vcp << "ERR syntax" << modm::endl;
+            return;
+        }
+        samples[count++] = value;
+    }
+    for(uint32_t i = 0; i < count; i++) {
+        if(!tach.pushSample(samples[i])) {
+            vcp << "ERR full" << modm::endl;
+            return;
+        }
+    }
+    vcp << "OK" << modm::endl;
+}
+
+void handleRemoteCommand(remote::Line &line) {
+    remote::Token t;
+    uint32_t value;
+    if(!line.next(t)) {
+        return;
+    }
+    if(line.equals(t, "SET")) {
+        remote::Token valueToken;
+        if(!line.next(valueToken) || line.more() || !line.toUint(valueToken, value) || value > 9999) {
+            vcp << "ERR syntax" << modm::endl;
+        } else {
+            setRpmSetting(value);
+            vcp << "OK" << modm::endl;
+        }
+    } else if(line.equals(t, "START") && !line.more()) {
+        if(motorEnable || stepTest.isRunning() || recipe.isRunning() || replaying) {
+            vcp << "ERR busy" << modm::endl;
+        } else {
+            onPlayClick();
+            vcp << "OK" << modm::endl;
+        }
+    } else if(line.equals(t, "STOP") && !line.more()) {
+        onStopClick();
+        vcp << "OK" << modm::endl;
+    } else if(line.equals(t, "GET") && !line.more()) {
+        const char *state = speedSupervisor.getFault() != SpeedSupervisor::Fault::None ? "FAULT" :
+            stepTest.isRunning() ? "STEP" : recipe.isRunning() ? "RECIPE" : motorEnable ? "RUN" : "IDLE";
+        vcp << "RPM " << measuredRpm << " " << activeSetpoint << " " << rpmSetting << " " << state << modm::endl;
+    } else if(line.equals(t, "ISR") && !line.more()) {
+        // Restart the measurement after each read
+        vcp << "ISR " << tim2LatencyMin << " " << tim2LatencyMax << modm::endl;
+        tim2LatencyMin = UINT32_MAX;
+        tim2LatencyMax = 0;
+#ifdef STSPIN_SPEED_TRIM
+    } else if(line.equals(t, "TRIM") && !line.more()) {
+        vcp << "TRIM " << (int32_t)(speedTrim.getTrim() * 1000.0f) << modm::endl;
+#endif
+#ifdef REFERENCE_TACH
+    } else if(line.equals(t, "REF") && !line.more()) {
+        vcp << "REF " << (uint32_t)(60 * referenceTach.getFrequency()) << modm::endl;
+#endif
+    } else if(line.equals(t, "BOOT") && !line.more()) {
+        printBootTimes();
+    } else if(line.equals(t, "JITTER") && !line.more()) {
+        printJitter("JITTER ");
+    } else if(line.equals(t, "SUB")) {
+        remote::Token periodToken;
+        if(!line.next(periodToken) || line.more() || !line.toUint(periodToken, value)) {
+            vcp << "ERR syntax" << modm::endl;
+        } else {
+            telemetryPeriodMs = value;
+            telemetryElapsedMs = 0;
+            vcp << "OK" << modm::endl;
+        }
+    } else if(line.equals(t, "CAL")) {
+        handleCalibrationCommand(line);
+    } else if(line.equals(t, "POLES")) {
+        handlePolePairsCommand(line);
+    } else if(line.equals(t, "PID")) {
+        handleGainsCommand(line);
+    } else if(line.equals(t, "RECIPE")) {
+        handleRecipeCommand(line);
+    } else if(line.equals(t, "CAPTURE")) {
+        handleCaptureCommand(line);
+    } else if(line.equals(t, "REPLAY")) {
+        handleReplayCommand(line);
+    } else if(line.equals(t, "S")) {
+        handleSamplesCommand(line);
+    } else {
+        vcp << "ERR unknown" << modm::endl;
+    }
+}
+
+void remoteTask() {
+    remote::Line line;
+    while(remoteReader.next(vcpRx::writeIndex(), line)) {
+        handleRemoteCommand(line);
+    }
+
+    if(telemetryPeriodMs > 0) {
+        telemetryElapsedMs += RemotePeriodUs / 1000;
+        if(telemetryElapsedMs >= telemetryPeriodMs) {
+            telemetryElapsedMs = 0;
+            vcp << "T " << measuredRpm << " " << activeSetpoint << modm::endl;
+        }
+    }
+}
+
+void settingsTask() {
+    settingsStore.task();
 }
 
 int main() {
     Board::initialize();
 
+    // The motor backend comes up first, so that the motor is stopped right
+    // away, e.g. after a watchdog reset while it was running
 #ifdef PWM_ESC_CONTROL
     setupPwm();
     setPulseWidth(800);
@@ -215,63 +1318,71 @@ int main() {
     motor::Uart::initialize<Board::SystemClock, 9600>();
     //motor::Pin::setOutput(true);
     motor::ConnectType::connect();
+    // All speeds are still 0
+    motorBus.send();
+#endif
+    tach.setSampleTap(captureSamples);
+#ifndef RUN_BENCHMARKS
+    // Benchmarks feed their own samples to the tach, so the ADC stays off
+    startSampleTimer<Timer2, Board::SystemClock>(DefaultTachConfig::SamplePeriodUs);
+    tach.initialize();
+#ifdef REFERENCE_TACH
+    referenceTach.initialize();
+#endif
+#endif
+    vcpRx::initialize();
+    loadSettings();
+#ifndef PWM_ESC_CONTROL
+    motorBus.motor(0).setPolePairs(motorPolePairs);
 #endif
-    freqCounter::initialize();
 
+    // The display itself is initialized by the UI task, see initDisplay()
     display::Spi::connect<display::Sck::Sck, display::Miso::Miso, display::Mosi::Mosi>();
 	display::Spi::initialize<Board::SystemClock, 2248_kHz, 20_pct>();
-	tft.initialize();
-    tft.enableBacklight(true);
-    tft.setRotation(modm::ili9341::Rotation::Rotate90);
 
     touchpins::Cs::setOutput(true);
     touch.initialize();
 
+#ifdef RUN_BENCHMARKS
+    initDisplay();
+    modm::IODeviceWrapper<Board::stlink::Uart, modm::IOBuffer::BlockIfFull> benchDevice;
+    modm::IOStream benchStream(benchDevice);
+    bench::Runner runner(benchStream);
+    bench::runBenchmarks<Tach, decltype(touch)>(runner, &tft);
+    runUiFrames(runner);
+    reportUiMemory(runner);
+    runner.finish();
+    while(true) {}
+#endif
+
 	Board::LedUser::set();
 
 	tft.setColor(modm::glcd::Color::red());
     tft.setBackgroundColor(modm::glcd::Color::white());
-    tft.clear();
-	int16_t w = tft.getWidth();
-	int16_t h = tft.getHeight();
+    // Bands are filled with the renderer's own background color
+    bandRenderer.setBackgroundColor(modm::glcd::Color::white());
 
+    // The first page is drawn over the whole screen, so the display needs no
+    // clear. It is drawn a band at a time, about 36 ms each, between the other
+    // tasks.
     BuildUi();
-    uiManager.redraw();
-    settingNumeric.setValue(rpmSetting);
-    settingNumeric.setActiveDigit(1);
-
-    while(true) {
-        freqCounter::task();
-
-        if(touchTimer.execute()) {
-            modm::glcd::Point p;
-            bool touch_active = touch.read(&p);
-
-            int16_t px = w - (p.x - touchCalibration::MinX) * w / (touchCalibration::MaxX - touchCalibration::MinX);
-            int16_t py = h - (p.y - touchCalibration::MinY) * h / (touchCalibration::MaxY - touchCalibration::MinY);
-            uiManager.handleTouchStatus(touch_active, px, py);
-        }
-
-        if(motorTimer.execute()) {
-            uint32_t rpm = (uint32_t)(60 * freqCounter::getFrequency());
-
-#ifdef PWM_ESC_CONTROL
-            if(motorEnable) {
-                motorControl.set_speed(rpmSetting);
-            } else {
-                motorControl.set_speed(0);
-            }
-            float pwm = motorControl.update((float)rpm);
-            setPulseWidth((uint32_t)pwm);
-#else
-
-            if(motorEnable) {
-                send_rpm_command<motor::Uart>(rpmSetting);
-            } else {
-                send_rpm_command<motor::Uart>(0);
-            }
-#endif
-            actualNumeric.setValue(rpm);
-        }
+    pages.setBandBudget(1);
+    if(Watchdog::causedReset()) {
+        mainPage.get<WatchdogLabel>().show();
+        vcp << "FAULT WATCHDOG" << modm::endl;
     }
-}
\ No newline at end of file
+
+    // Lower number is higher priority. Tasks are not preempted, so a long UI
+    // redraw can still delay the control task by up to one redraw.
+    controlTaskId = scheduler.addTask("control", controlTask, 0, MotorPeriodUs, 2000);
+    scheduler.addTask("tach", tachTask, 1, TachPeriodUs, TachPeriodUs);
+    scheduler.addTask("touch", touchTask, 2, TouchPeriodUs, TouchPeriodUs);
+    uiTaskId = scheduler.addTask("ui", uiTask, 3);
+    scheduler.addTask("remote", remoteTask, 4, RemotePeriodUs);
+    scheduler.addTask("settings", settingsTask, 5, SettingsPeriodUs);
+    Watchdog::start(WatchdogTimeoutMs);
+    // Control runs first, without waiting for its period, and then hands
+    // over to the UI task to bring up the display
+    scheduler.signal(controlTaskId);
+    scheduler.run();
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+namespace settings {
+
+/** RAM emulation of the settings flash for host builds
+ *
+ * Follows the rules of the STM32G4 flash: erased bits read as 1, a page is the
+ * smallest unit that can be erased, and a double-word can only be programmed
+ * once after an erase.
+ *
+ * For power loss testing, `cutPowerAfter(n)` makes the n-th following flash
+ * operation fail part way through: a program leaves a partially written
+ * double-word, and an erase leaves part of the page unerased. Every operation
+ * after that fails until `restorePower()` is called, which simulates the
+ * reboot.
+ *
+ * With `setTornEccErrors(true)`, the torn double-word, or the first one left
+ * unerased, also fails its ECC check, as it can on the G4. Reading it there
+ * raises an NMI, whose handler overwrites it with zeros; here, `data()` does
+ * the same to any such double-word in the page before it is read.
+ *
+ * The memory starts out zeroed rather than erased; `reset()` gives a blank,
+ * fully erased flash.
+ */
+template<uint32_t PageSizeT, uint8_t NumPagesT>
+class EmulatedFlashBackend {
+public:
+    static constexpr uint32_t PageSize = PageSizeT;
+    static constexpr uint8_t NumPages = NumPagesT;
+
+    static const uint8_t* data(uint8_t page) {
+        if(!powerOff) {
+            for(uint32_t i = 0; i < PageSize / 8; i++) {
+                if(eccError[page][i]) {
+                    memset(&memory[page][i * 8], 0, 8);
+                    eccError[page][i] = false;
+                    eccRepairs++;
+                }
+            }
+        }
+        return &memory[page][0];
+    }
+
+    static bool erase(uint8_t page) {
+        if(!takePower()) {
+            if(powerCutNow) {
+                // Erase interrupted half way
+                memset(memory[page], 0xff, PageSize / 2);
+                memset(eccError[page], 0, PageSize / 16);
+                eccError[page][PageSize / 16] = tornEccErrors;
+                powerCutNow = false;
+            }
+            return false;
+        }
+        memset(memory[page], 0xff, PageSize);
+        memset(eccError[page], 0, sizeof(eccError[page]));
+        eraseCount[page]++;
+        completedOps++;
+        return true;
+    }
+
+    static bool program(uint8_t page, uint32_t offset, uint64_t value) {
+        if(offset % 8 != 0 || offset + 8 > PageSize) {
+            return false;
+        }
+        uint8_t *dst = &memory[page][offset];
+        for(uint32_t i = 0; i < 8; i++) {
+            if(dst[i] != 0xff) {
+                // Programming a non-erased double-word is an error on the G4
+                return false;
+            }
+        }
+        uint8_t src[8];
+        memcpy(src, &value, sizeof(src));
+        if(!takePower()) {
+            if(powerCutNow) {
+                // Program interrupted: only some of the bits are cleared
+                for(uint32_t i = 0; i < 4; i++) {
+                    dst[i] &= src[i];
+                }
+                eccError[page][offset / 8] = tornEccErrors;
+                powerCutNow = false;
+            }
+            return false;
+        }
+        for(uint32_t i = 0; i < 8; i++) {
+            dst[i] &= src[i];
+        }
+        completedOps++;
+        return true;
+    }
+
+    static void reset() {
+        memset(memory, 0xff, sizeof(memory));
+        memset(eccError, 0, sizeof(eccError));
+        memset(eraseCount, 0, sizeof(eraseCount));
+        completedOps = 0;
+        eccRepairs = 0;
+        restorePower();
+    }
+
+    static void setTornEccErrors(bool enable) {
+        tornEccErrors = enable;
+    }
+
+    static void cutPowerAfter(uint32_t operations) {
+        opsUntilPowerCut = operations;
+        powerCutArmed = true;
+        powerCutNow = false;
+        powerOff = false;
+    }
+
+    static void restorePower() {
+        powerCutArmed = false;
+        powerCutNow = false;
+        powerOff = false;
+    }
+
+    static bool isPowerOff() {
+        return powerOff;
+    }
+
+    static uint32_t getEraseCount(uint8_t page) {
+        return eraseCount[page];
+    }
+
+    /** Completed erases and programs since the last reset() */
+    static uint32_t getOperationCount() {
+        return completedOps;
+    }
+
+    /** Double-words with an ECC error zeroed since the last reset() */
+    static uint32_t getEccRepairs() {
+        return eccRepairs;
+    }
+
+private:
+    static bool takePower() {
+        if(powerOff) {
+            return false;
+        }
+        if(powerCutArmed) {
+            if(opsUntilPowerCut == 0) {
+                powerOff = true;
+                powerCutNow = true;
+                return false;
+            }
+            opsUntilPowerCut--;
+        }
+        return true;
+    }
+
+    static inline uint8_t memory[NumPages][PageSize] = {};
+    static inline bool eccError[NumPages][PageSize / 8] = {};
+    static inline uint32_t eraseCount[NumPages] = {};
+    static inline uint32_t completedOps = 0;
+    static inline uint32_t eccRepairs = 0;
+    static inline bool tornEccErrors = false;
+    static inline uint32_t opsUntilPowerCut = 0;
+    static inline bool powerCutArmed = false;
+    static inline bool powerCutNow = false;
+    static inline bool powerOff = false;
+};
+
+} // namespace settings
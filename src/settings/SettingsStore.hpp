@@ -0,0 +1,505 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+namespace settings {
+
+// Keys for values kept in the settings store. Records in flash refer to keys by
+// number, so new keys must only ever be appended; never reuse or renumber one.
+enum class Key : uint8_t {
+    RpmSetting = 0,
+    TouchMinX,
+    TouchMinY,
+    TouchMaxX,
+    TouchMaxY,
+    MotorPolePairs,
+    Kp,
+    Ki,
+    Kd,
+    NumKeys
+};
+
+/** Log-structured key/value store for a small set of persistent settings
+ *
+ * The store owns a ring of NumPages flash pages provided by `Backend`. Only one
+ * page is active at a time. Writes are appended to the active page as fixed
+ * size records:
+ *
+ *   word 0: key (16 bits) | length (16 bits)
+ *   word 1-2: value, padded with 0xff
+ *   word 3: CRC-32 of words 0-2
+ *
+ * A record is programmed as two double-words, so a write torn by a power loss
+ * leaves a record with a bad CRC, which is skipped at boot. The latest valid
+ * record for a key wins.
+ *
+ * Each page starts with a header record carrying a sequence number. When the
+ * active page runs low on space, the live values are copied to the next page in
+ * the ring, and only then is the new page header written, which commits the
+ * switch. A loss of power at any point leaves either the old or the new page as
+ * the valid one. Because every compaction moves to the next page, erase cycles
+ * are spread evenly over the ring.
+ *
+ * Compaction is done a step at a time from `task()`, so that the main loop is
+ * never blocked by more than one page erase or one record copy at once. Note
+ * that on the single bank G431, the core still stalls on flash reads while an
+ * erase is in progress. If writes come faster than the compaction, and find
+ * the active page full, they are held in RAM and written by `task()` once the
+ * compaction is done, rather than `set()` running the rest of it there and
+ * then. Until then, a held write is lost on a power failure.
+ *
+ * Reading a double-word whose program was torn can raise an ECC double error.
+ * On the G4 that is an NMI, whose handler must overwrite the double-word with
+ * zeros (see Stm32FlashBackend::repairEccError()). A zeroed double-word never
+ * passes the CRC, so the store takes it for a torn record, or in a page
+ * header, for a page without a valid one.
+ *
+ * The backend must provide:
+ *
+ *   static constexpr uint32_t PageSize;
+ *   static constexpr uint8_t NumPages;
+ *   static const uint8_t* data(uint8_t page);
+ *   static bool erase(uint8_t page);
+ *   static bool program(uint8_t page, uint32_t offset, uint64_t value);
+ */
+template<class Backend>
+class SettingsStore {
+public:
+    static constexpr uint32_t RecordSize = 16;
+    static constexpr uint32_t MaxValueSize = 8;
+    static constexpr uint32_t NumKeys = (uint32_t)Key::NumKeys;
+    static constexpr uint32_t RecordsPerPage = Backend::PageSize / RecordSize;
+
+    static_assert(Backend::NumPages >= 2, "Settings store needs at least two pages");
+    // One slot is the page header, and a compaction must always be able to fit
+    // one record per key, plus room to keep accepting writes while it runs
+    static_assert(RecordsPerPage > 2 * NumKeys + 1, "Settings page too small for key count");
+
+    SettingsStore() :
+        activePage(0),
+        writeOffset(0),
+        sequence(0),
+        compactState(CompactState::Idle),
+        compactKey(0)
+    {
+        clearIndex();
+        clearPending();
+    }
+
+    /** Restore the index from flash
+     *
+     * Finds the active page from the page headers, and then makes a single
+     * pass over its records to rebuild the index. If no valid page is found,
+     * the store is formatted.
+     */
+    void initialize() {
+        bool found = false;
+        for(uint8_t page = 0; page < Backend::NumPages; page++) {
+            uint32_t seq;
+            if(readPageHeader(page, &seq) && (!found || (int32_t)(seq - sequence) > 0)) {
+                found = true;
+                activePage = page;
+                sequence = seq;
+            }
+        }
+
+        clearIndex();
+        clearPending();
+        compactState = CompactState::Idle;
+
+        if(!found) {
+            format();
+            return;
+        }
+
+        writeOffset = RecordSize;
+        while(writeOffset < Backend::PageSize) {
+            const uint8_t *rec = Backend::data(activePage) + writeOffset;
+            if(isErased(rec)) {
+                break;
+            }
+            uint16_t key;
+            if(checkRecord(rec, &key) && key < NumKeys) {
+                index[key] = writeOffset;
+            }
+            // Invalid (torn) records are left in place and skipped
+            writeOffset += RecordSize;
+        }
+
+        // A page left over from an interrupted compaction, or one that was not
+        // yet erased after a completed one, is cleaned up in the background
+        for(uint8_t page = 0; page < Backend::NumPages; page++) {
+            if(page != activePage && !isPageErased(page)) {
+                compactState = CompactState::EraseStale;
+                break;
+            }
+        }
+        if(compactState == CompactState::Idle && spaceLow()) {
+            compactState = CompactState::EraseTarget;
+        }
+    }
+
+    /** Read the value stored for `key`
+     *
+     * @return false if there is no value stored, in which case `value` is
+     * unmodified.
+     */
+    template<typename T>
+    bool get(Key key, T &value) const {
+        static_assert(std::is_trivially_copyable<T>::value, "Settings values must be trivially copyable");
+        static_assert(sizeof(T) <= MaxValueSize, "Settings value too large");
+        uint8_t k = (uint8_t)key;
+        if(pendingLength[k] != 0) {
+            if(pendingLength[k] != sizeof(T)) {
+                return false;
+            }
+            memcpy(&value, pendingValue[k], sizeof(T));
+            return true;
+        }
+        uint16_t offset = index[k];
+        if(offset == 0) {
+            return false;
+        }
+        const uint8_t *rec = Backend::data(activePage) + offset;
+        uint16_t length;
+        memcpy(&length, rec + 2, sizeof(length));
+        if(length != sizeof(T)) {
+            return false;
+        }
+        memcpy(&value, rec + 4, sizeof(T));
+        return true;
+    }
+
+    /** Read the value stored for `key`, or `defaultValue` if there is none */
+    template<typename T>
+    T getOr(Key key, T defaultValue) const {
+        T value = defaultValue;
+        get(key, value);
+        return value;
+    }
+
+    /** Store a value for `key`
+     *
+     * Nothing is written if the stored value is already equal. If the active
+     * page is full until a compaction finishes, the value is held and written
+     * later by `task()`; `get()` returns it at once, and `isPending()` tells
+     * whether it has reached the flash yet.
+     *
+     * @return false if the flash write failed
+     */
+    template<typename T>
+    bool set(Key key, const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Settings values must be trivially copyable");
+        static_assert(sizeof(T) <= MaxValueSize, "Settings value too large");
+        T current;
+        if(get(key, current) && memcmp(&current, &value, sizeof(T)) == 0) {
+            return true;
+        }
+
+        uint8_t k = (uint8_t)key;
+        if(writeOffset + RecordSize > Backend::PageSize) {
+            // Out of room until the compaction is done
+            memcpy(pendingValue[k], &value, sizeof(T));
+            pendingLength[k] = sizeof(T);
+            if(compactState == CompactState::Idle) {
+                compactState = CompactState::EraseTarget;
+            }
+            return true;
+        }
+
+        if(!appendRecord(activePage, writeOffset, k, &value, sizeof(T))) {
+            // Skip over the failed slot so it is not programmed twice
+            writeOffset += RecordSize;
+            return false;
+        }
+        index[k] = writeOffset;
+        writeOffset += RecordSize;
+        pendingLength[k] = 0;
+
+        // If the key was already copied by a compaction in progress, the new
+        // value has to go to the target page too
+        if((compactState == CompactState::CopyRecords && k < compactKey) ||
+            compactState == CompactState::Commit) {
+            if(!appendRecord(targetPage(), targetOffset, k, &value, sizeof(T))) {
+                compactState = CompactState::EraseTarget;
+            } else {
+                targetOffset += RecordSize;
+            }
+        }
+
+        if(compactState == CompactState::Idle && spaceLow()) {
+            compactState = CompactState::EraseTarget;
+        }
+        return true;
+    }
+
+    /** Perform one step of background compaction, if one is pending
+     *
+     * Should be called regularly from the main loop.
+     *
+     * @return false if a flash operation failed
+     */
+    bool task() {
+        // Writes held while the page was full go first, one per step
+        if((compactState == CompactState::Idle || compactState == CompactState::EraseStale) &&
+            writeOffset + RecordSize <= Backend::PageSize) {
+            for(uint8_t k = 0; k < NumKeys; k++) {
+                if(pendingLength[k] != 0) {
+                    return writePending(k);
+                }
+            }
+        }
+
+        switch(compactState) {
+        case CompactState::Idle:
+            return true;
+
+        case CompactState::EraseStale:
+            for(uint8_t page = 0; page < Backend::NumPages; page++) {
+                if(page != activePage && !isPageErased(page)) {
+                    if(!Backend::erase(page)) {
+                        return false;
+                    }
+                    // One erase per step
+                    return true;
+                }
+            }
+            compactState = spaceLow() ? CompactState::EraseTarget : CompactState::Idle;
+            return true;
+
+        case CompactState::EraseTarget:
+            if(!isPageErased(targetPage()) && !Backend::erase(targetPage())) {
+                return false;
+            }
+            compactKey = 0;
+            targetOffset = RecordSize;
+            compactState = CompactState::CopyRecords;
+            return true;
+
+        case CompactState::CopyRecords:
+            // Skip over keys without a value, and copy one record per step
+            while(compactKey < NumKeys && index[compactKey] == 0) {
+                compactKey++;
+            }
+            if(compactKey < NumKeys) {
+                const uint8_t *rec = Backend::data(activePage) + index[compactKey];
+                uint16_t length;
+                memcpy(&length, rec + 2, sizeof(length));
+                if(!appendRecord(targetPage(), targetOffset, compactKey, rec + 4, length)) {
+                    compactState = CompactState::EraseTarget;
+                    return false;
+                }
+                targetOffset += RecordSize;
+                compactKey++;
+            } else {
+                compactState = CompactState::Commit;
+            }
+            return true;
+
+        case CompactState::Commit: {
+            if(!writePageHeader(targetPage(), sequence + 1)) {
+                compactState = CompactState::EraseTarget;
+                return false;
+            }
+            // Rebuild the index for the new page; records were copied in key
+            // order, followed by any written during the compaction
+            uint8_t newPage = targetPage();
+            clearIndex();
+            for(uint32_t offset = RecordSize; offset < targetOffset; offset += RecordSize) {
+                uint16_t key;
+                if(checkRecord(Backend::data(newPage) + offset, &key) && key < NumKeys) {
+                    index[key] = offset;
+                }
+            }
+            activePage = newPage;
+            writeOffset = targetOffset;
+            sequence++;
+            compactState = CompactState::EraseStale;
+            return true;
+        }
+        }
+        return true;
+    }
+
+    /** Erase all pages and start an empty store */
+    bool format() {
+        for(uint8_t page = 0; page < Backend::NumPages; page++) {
+            if(!isPageErased(page) && !Backend::erase(page)) {
+                return false;
+            }
+        }
+        clearIndex();
+        clearPending();
+        activePage = 0;
+        sequence = 0;
+        writeOffset = RecordSize;
+        compactState = CompactState::Idle;
+        return writePageHeader(activePage, sequence);
+    }
+
+    bool isCompacting() const {
+        return compactState != CompactState::Idle;
+    }
+
+    /** True if the value of `key` is held in RAM, waiting for a compaction */
+    bool isPending(Key key) const {
+        return pendingLength[(uint8_t)key] != 0;
+    }
+
+    uint8_t getActivePage() const {
+        return activePage;
+    }
+
+    uint32_t getFreeRecords() const {
+        return (Backend::PageSize - writeOffset) / RecordSize;
+    }
+
+private:
+    enum class CompactState : uint8_t {
+        Idle,
+        EraseStale,
+        EraseTarget,
+        CopyRecords,
+        Commit
+    };
+
+    // Page header uses a reserved key value, which can never be a setting
+    static constexpr uint16_t HeaderKey = 0x5343;
+    static constexpr uint16_t HeaderLength = 4;
+
+    uint8_t targetPage() const {
+        return (activePage + 1) % Backend::NumPages;
+    }
+
+    bool spaceLow() const {
+        // Keep enough room to absorb one write per key while a compaction runs
+        return (Backend::PageSize - writeOffset) / RecordSize <= NumKeys;
+    }
+
+    void clearIndex() {
+        for(auto &i : index) {
+            i = 0;
+        }
+    }
+
+    void clearPending() {
+        for(auto &l : pendingLength) {
+            l = 0;
+        }
+    }
+
+    bool writePending(uint8_t k) {
+        if(!appendRecord(activePage, writeOffset, k, pendingValue[k], pendingLength[k])) {
+            writeOffset += RecordSize;
+            return false;
+        }
+        index[k] = writeOffset;
+        writeOffset += RecordSize;
+        pendingLength[k] = 0;
+        if(compactState == CompactState::Idle && spaceLow()) {
+            compactState = CompactState::EraseTarget;
+        }
+        return true;
+    }
+
+    bool isPageErased(uint8_t page) const {
+        const uint8_t *p = Backend::data(page);
+        for(uint32_t i = 0; i < Backend::PageSize; i++) {
+            if(p[i] != 0xff) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool isErased(const uint8_t *rec) {
+        for(uint32_t i = 0; i < RecordSize; i++) {
+            if(rec[i] != 0xff) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool checkRecord(const uint8_t *rec, uint16_t *key) {
+        uint32_t crc;
+        memcpy(&crc, rec + 12, sizeof(crc));
+        if(crc != crc32(rec, 12)) {
+            return false;
+        }
+        uint16_t length;
+        memcpy(key, rec, sizeof(*key));
+        memcpy(&length, rec + 2, sizeof(length));
+        return length <= MaxValueSize;
+    }
+
+    bool readPageHeader(uint8_t page, uint32_t *seq) const {
+        const uint8_t *rec = Backend::data(page);
+        uint16_t key;
+        if(!checkRecord(rec, &key) || key != HeaderKey) {
+            return false;
+        }
+        memcpy(seq, rec + 4, sizeof(*seq));
+        return true;
+    }
+
+    bool writePageHeader(uint8_t page, uint32_t seq) {
+        uint8_t rec[RecordSize];
+        encodeRecord(rec, HeaderKey, &seq, HeaderLength);
+        return programRecord(page, 0, rec);
+    }
+
+    bool appendRecord(uint8_t page, uint32_t offset, uint16_t key, const void *value, uint16_t length) {
+        if(offset + RecordSize > Backend::PageSize) {
+            return false;
+        }
+        uint8_t rec[RecordSize];
+        encodeRecord(rec, key, value, length);
+        return programRecord(page, offset, rec);
+    }
+
+    static void encodeRecord(uint8_t *rec, uint16_t key, const void *value, uint16_t length) {
+        memset(rec, 0xff, RecordSize);
+        memcpy(rec, &key, sizeof(key));
+        memcpy(rec + 2, &length, sizeof(length));
+        memcpy(rec + 4, value, length);
+        uint32_t crc = crc32(rec, 12);
+        memcpy(rec + 12, &crc, sizeof(crc));
+    }
+
+    static bool programRecord(uint8_t page, uint32_t offset, const uint8_t *rec) {
+        uint64_t lo, hi;
+        memcpy(&lo, rec, sizeof(lo));
+        memcpy(&hi, rec + 8, sizeof(hi));
+        // The double-word holding the CRC goes last, so a torn write never
+        // leaves a record that looks valid
+        return Backend::program(page, offset, lo) && Backend::program(page, offset + 8, hi);
+    }
+
+    static uint32_t crc32(const uint8_t *data, uint32_t length) {
+        uint32_t crc = 0xffffffff;
+        for(uint32_t i = 0; i < length; i++) {
+            crc ^= data[i];
+            for(uint8_t bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+            }
+        }
+        return ~crc;
+    }
+
+    // Offset of the latest record for each key in the active page; 0 if none
+    uint16_t index[NumKeys];
+    // Values written while the active page was full; a length of 0 if none
+    uint8_t pendingValue[NumKeys][MaxValueSize];
+    uint8_t pendingLength[NumKeys];
+    uint8_t activePage;
+    uint32_t writeOffset;
+    uint32_t sequence;
+    CompactState compactState;
+    uint8_t compactKey;
+    uint32_t targetOffset;
+};
+
+} // namespace settings
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <modm/platform.hpp>
+
+namespace settings {
+
+/** Settings store backend on the internal flash of the STM32G431
+ *
+ * Uses the last `N` 2 KiB pages of the 128 KiB flash. These pages are kept out
+ * of the application image by the `linkerscript.flash_reserved` option in
+ * project.xml, which must be at least `N * PageSize`.
+ */
+template<uint8_t N>
+class Stm32FlashBackend {
+public:
+    static constexpr uint32_t PageSize = 2048;
+    static constexpr uint8_t NumPages = N;
+
+    static const uint8_t* data(uint8_t page) {
+        return (const uint8_t*)(FlashBase + (FirstPage + page) * PageSize);
+    }
+
+    static bool erase(uint8_t page) {
+        if(!modm::platform::Flash::unlock()) {
+            return false;
+        }
+        uint32_t err = modm::platform::Flash::erase(FirstPage + page);
+        modm::platform::Flash::lock();
+        return err == 0;
+    }
+
+    static bool program(uint8_t page, uint32_t offset, uint64_t value) {
+        if(!modm::platform::Flash::unlock()) {
+            return false;
+        }
+        uint32_t err = modm::platform::Flash::program((uintptr_t)data(page) + offset, value);
+        modm::platform::Flash::lock();
+        return err == 0;
+    }
+
+    /** Repair a double ECC error in the settings pages; call from the NMI handler
+     *
+     * A double-word whose program was torn by a power loss can fail its ECC
+     * check, and reading it raises an NMI. It is overwritten with zeros, which
+     * the G4 allows on a programmed double-word, so that it reads back without
+     * an error from then on. The store never takes zeros for a valid record.
+     *
+     * @return false if the NMI has another cause, or the error is elsewhere
+     */
+    static bool repairEccError() {
+        uint32_t eccr = FLASH->ECCR;
+        if(!(eccr & FLASH_ECCR_ECCD) || (eccr & FLASH_ECCR_SYSF_ECC)) {
+            return false;
+        }
+        uintptr_t address = FlashBase + (eccr & FLASH_ECCR_ADDR_ECC);
+        if(address < (uintptr_t)data(0) || address >= (uintptr_t)data(0) + NumPages * PageSize) {
+            return false;
+        }
+        FLASH->ECCR = eccr | FLASH_ECCR_ECCD;
+        if(!modm::platform::Flash::unlock()) {
+            return false;
+        }
+        uint32_t err = modm::platform::Flash::program(address & ~(uintptr_t)7, 0);
+        modm::platform::Flash::lock();
+        return err == 0;
+    }
+
+private:
+    static constexpr uintptr_t FlashBase = 0x0800'0000;
+    static constexpr uint32_t FlashSize = 128 * 1024;
+    static constexpr uint8_t FirstPage = FlashSize / PageSize - N;
+};
+
+} // namespace settings
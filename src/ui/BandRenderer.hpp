@@ -0,0 +1,152 @@
+#pragma once
+
+#include <stdint.h>
+#include <modm/ui/display/graphic_display.hpp>
+
+#include "Rect.hpp"
+
+namespace ui {
+
+/** Off-screen canvas holding one horizontal band of the screen
+ *
+ * Screen elements draw into the canvas with the normal GraphicDisplay calls,
+ * and everything outside the current band is clipped. When the band is
+ * complete, it goes to the display as a single windowed transfer, so the SPI
+ * cost of an update depends only on the area redrawn, and not on how many
+ * primitives the elements use. Overlapping elements are composed in RAM first, so they don't
+ * flicker.
+ *
+ * The band is as wide as the area being redrawn, and as many rows high as fit
+ * in the pixel buffer, so narrow updates often fit in one band.
+ */
+class BandCanvas : public modm::GraphicDisplay {
+public:
+    BandCanvas(modm::GraphicDisplay *_target, uint16_t *_buffer, uint32_t _capacity) :
+        target(_target),
+        buffer(_buffer),
+        capacity(_capacity),
+        band{0, 0, 0, 0},
+        bytesSent(0)
+    {
+
+    }
+
+    uint16_t getWidth() const override {
+        return target->getWidth();
+    }
+
+    uint16_t getHeight() const override {
+        return target->getHeight();
+    }
+
+    std::size_t getBufferWidth() const override {
+        return target->getWidth();
+    }
+
+    std::size_t getBufferHeight() const override {
+        return target->getHeight();
+    }
+
+    // Nothing is drawn outside of a band, so these have nothing to do
+    void clear() override {}
+    void update() override {}
+
+    /** Number of rows in a band for an area of the given width */
+    uint16_t rowsPerBand(uint16_t width) const {
+        return width > 0 ? capacity / width : 0;
+    }
+
+    /** Start a band, filled with the background color */
+    void beginBand(const Rect &r) {
+        band = r;
+        uint16_t bg = backgroundColor.getValue();
+        uint32_t count = (uint32_t)r.width * r.height;
+        for(uint32_t i = 0; i < count; i++) {
+            buffer[i] = bg;
+        }
+    }
+
+    /** Send the finished band to the display */
+    virtual void endBand() = 0;
+
+    const Rect& getBand() const {
+        return band;
+    }
+
+    /** Total pixel data sent to the display, in bytes */
+    uint32_t getBytesSent() const {
+        return bytesSent;
+    }
+
+    void setPixel(int16_t x, int16_t y) override {
+        if(inBand(x, y)) {
+            buffer[(y - band.top) * band.width + (x - band.left)] = foregroundColor.getValue();
+        }
+    }
+
+    void clearPixel(int16_t x, int16_t y) override {
+        if(inBand(x, y)) {
+            buffer[(y - band.top) * band.width + (x - band.left)] = backgroundColor.getValue();
+        }
+    }
+
+    bool getPixel(int16_t x, int16_t y) override {
+        if(inBand(x, y)) {
+            return buffer[(y - band.top) * band.width + (x - band.left)] != backgroundColor.getValue();
+        }
+        return false;
+    }
+
+    /** Draw an RGB565 image, as stored by images/convert_images.py
+     *
+     * This matches the color bitmap drawing of the display driver, which the
+     * image buttons rely on.
+     */
+    void drawBitmap(modm::glcd::Point upperLeft, uint16_t width, uint16_t height, modm::accessor::Flash<uint8_t> data) override {
+        Rect r = Rect{upperLeft.x, upperLeft.y, (int16_t)width, (int16_t)height}.intersection(band);
+        for(int16_t y = r.top; y < r.bottom(); y++) {
+            uint32_t src = ((y - upperLeft.y) * width + (r.left - upperLeft.x)) * 2;
+            uint16_t *dst = &buffer[(y - band.top) * band.width + (r.left - band.left)];
+            for(int16_t x = r.left; x < r.right(); x++) {
+                *dst++ = data[src] | (data[src + 1] << 8);
+                src += 2;
+            }
+        }
+    }
+
+protected:
+    bool inBand(int16_t x, int16_t y) const {
+        return x >= band.left && x < band.right() && y >= band.top && y < band.bottom();
+    }
+
+    modm::GraphicDisplay *target;
+    uint16_t *buffer;
+    uint32_t capacity;
+    Rect band;
+    uint32_t bytesSent;
+};
+
+/** Band canvas with its own pixel buffer, sending bands to an ILI9341 */
+template<class Display, uint32_t Capacity>
+class BandRenderer : public BandCanvas {
+public:
+    BandRenderer(Display *_display) :
+        BandCanvas(_display, pixels, Capacity),
+        display(_display)
+    {
+
+    }
+
+    void endBand() override {
+        // drawRaw byte swaps the buffer in place, which is fine since every
+        // band is drawn from scratch
+        display->drawRaw({band.left, band.top}, band.width, band.height, pixels);
+        bytesSent += (uint32_t)band.width * band.height * 2;
+    }
+
+private:
+    Display *display;
+    uint16_t pixels[Capacity];
+};
+
+} // namespace ui
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stdint.h>
+#include <modm/ui/display/graphic_display.hpp>
+
+#include "BandRenderer.hpp"
+
+namespace ui {
+
+/** Band canvas which records what would be sent to the display, without sending it
+ *
+ * For each band it counts one draw call, and the bytes which would cross the
+ * SPI bus: the band's pixel data, plus the commands which set up the window
+ * and start the memory write.
+ *
+ * It also keeps a hash of what the screen shows, so that a rendering change
+ * can be detected by comparing hashes against known good ones. There is no
+ * RAM for a frame buffer, so the screen is kept as one hash per row, over the
+ * row's full width and keyed by its y. After a frame, hashScreen() hashes the
+ * rows the frame drew into again, from the UI as it is now; the other rows
+ * keep their hashes. So the result doesn't depend on how the frame was split
+ * into bands, but a row which should have been redrawn and wasn't still
+ * shows up as a changed hash.
+ *
+ * Used by the benchmark build to account for UI updates.
+ */
+template<uint32_t Capacity>
+class CountingCanvas : public BandCanvas {
+public:
+    // Column and page address set (command + 4 bytes each), then memory write
+    static const uint32_t TransferOverheadBytes = 11;
+    static const uint16_t MaxRows = 320;
+
+    // Draws everything on the screen which intersects a band
+    using DrawBand = void (*)(modm::GraphicDisplay *d, const Rect &band);
+
+    CountingCanvas(modm::GraphicDisplay *_target, DrawBand _drawScreen = NULL) :
+        BandCanvas(_target, pixels, Capacity),
+        drawScreen(_drawScreen)
+    {
+        reset();
+        for(uint16_t y = 0; y < MaxRows; y++) {
+            rowHashes[y] = FnvOffset;
+            rowsDrawn[y] = false;
+        }
+        hash = FnvOffset;
+    }
+
+    /** Restart the counts for the next frame; the screen hash is kept */
+    void reset() {
+        drawCalls = 0;
+        pixelCount = 0;
+        byteCount = 0;
+    }
+
+    void endBand() override {
+        uint32_t count = (uint32_t)band.width * band.height;
+        drawCalls++;
+        pixelCount += count;
+        byteCount += count * 2 + TransferOverheadBytes;
+        for(int16_t y = band.top; y < band.bottom(); y++) {
+            if(y >= 0 && y < MaxRows) {
+                rowsDrawn[y] = true;
+            }
+        }
+    }
+
+    /** Update the screen hash for the rows drawn since the last call
+     *
+     * Does nothing if the canvas was made without a `drawScreen` function.
+     */
+    void hashScreen() {
+        if(!drawScreen) {
+            return;
+        }
+        int16_t width = getWidth();
+        int16_t height = getHeight() < MaxRows ? getHeight() : MaxRows;
+        int16_t rows = rowsPerBand(width);
+        for(int16_t top = 0; top < height; top += rows) {
+            int16_t h = top + rows <= height ? rows : height - top;
+            if(!anyRowDrawn(top, h)) {
+                continue;
+            }
+            Rect r = {0, top, width, h};
+            beginBand(r);
+            drawScreen(this, r);
+            for(int16_t y = top; y < top + h; y++) {
+                if(rowsDrawn[y]) {
+                    rowHashes[y] = hashRow(y, &pixels[(y - top) * width], width);
+                    rowsDrawn[y] = false;
+                }
+            }
+        }
+        hash = FnvOffset;
+        for(int16_t y = 0; y < height; y++) {
+            hash = fnv(hash, rowHashes[y]);
+        }
+    }
+
+    uint32_t getDrawCalls() const {
+        return drawCalls;
+    }
+
+    uint32_t getPixels() const {
+        return pixelCount;
+    }
+
+    uint32_t getBytes() const {
+        return byteCount;
+    }
+
+    /** Hash of the screen, as of the last hashScreen() */
+    uint32_t getHash() const {
+        return hash;
+    }
+
+private:
+    static const uint32_t FnvOffset = 2166136261u;
+    static const uint32_t FnvPrime = 16777619u;
+
+    // FNV-1a over the bytes of `value`, most significant first
+    static uint32_t fnv(uint32_t h, uint32_t value) {
+        for(int shift = 24; shift >= 0; shift -= 8) {
+            h = (h ^ ((value >> shift) & 0xff)) * FnvPrime;
+        }
+        return h;
+    }
+
+    // Pixels as they would be sent, keyed by the row
+    static uint32_t hashRow(int16_t y, const uint16_t *row, int16_t width) {
+        uint32_t h = fnv(FnvOffset, y);
+        for(int16_t x = 0; x < width; x++) {
+            h = (h ^ (row[x] >> 8)) * FnvPrime;
+            h = (h ^ (row[x] & 0xff)) * FnvPrime;
+        }
+        return h;
+    }
+
+    bool anyRowDrawn(int16_t top, int16_t height) const {
+        for(int16_t y = top; y < top + height; y++) {
+            if(rowsDrawn[y]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    DrawBand drawScreen;
+    uint16_t pixels[Capacity];
+    uint32_t rowHashes[MaxRows];
+    bool rowsDrawn[MaxRows];
+    uint32_t drawCalls;
+    uint32_t pixelCount;
+    uint32_t byteCount;
+    uint32_t hash;
+};
+
+} // namespace ui
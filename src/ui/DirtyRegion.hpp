@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Rect.hpp"
+#include "BandRenderer.hpp"
+
+namespace ui {
+
+/** Set of screen areas waiting to be redrawn
+ *
+ * Kept as up to `MaxAreas` rects. An area which touches one already in the set
+ * is merged into it, unless their bounding rect is larger than the two areas
+ * together; then both are kept, and their overlap, if any, is drawn twice.
+ * When all slots are used, a new area is merged with the one that grows the
+ * least.
+ *
+ * Tracking can be suspended, e.g. for a page which isn't shown, so that
+ * changes to it cost nothing until it is drawn again in full.
+ */
+template<uint8_t MaxAreas>
+class BasicDirtyRegion {
+public:
+    BasicDirtyRegion() : numAreas(0), tracking(true) {}
+
+    void add(Rect r) {
+        if(!tracking || r.empty()) {
+            return;
+        }
+        bool merged = true;
+        while(merged) {
+            merged = false;
+            for(uint8_t i = 0; i < numAreas; i++) {
+                if(areas[i].touches(r) && areas[i].unite(r).area() <= areas[i].area() + r.area()) {
+                    r = r.unite(areas[i]);
+                    areas[i] = areas[--numAreas];
+                    merged = true;
+                    break;
+                }
+            }
+        }
+        if(numAreas == MaxAreas) {
+            uint8_t best = 0;
+            int32_t bestGrowth = INT32_MAX;
+            for(uint8_t i = 0; i < numAreas; i++) {
+                int32_t growth = areas[i].unite(r).area() - areas[i].area();
+                if(growth < bestGrowth) {
+                    bestGrowth = growth;
+                    best = i;
+                }
+            }
+            r = r.unite(areas[best]);
+            areas[best] = areas[--numAreas];
+            add(r);
+            return;
+        }
+        areas[numAreas++] = r;
+    }
+
+    bool empty() const {
+        return numAreas == 0;
+    }
+
+    void clear() {
+        numAreas = 0;
+    }
+
+    /** Start or stop recording areas; stopping also clears the region */
+    void setTracking(bool enable) {
+        tracking = enable;
+        if(!enable) {
+            clear();
+        }
+    }
+
+    /** Redraw all areas through `canvas`, and clear the region
+     *
+     * Each area is split into bands as tall as fit in the canvas. For each
+     * band, `drawBand(band)` must draw everything that intersects it.
+     */
+    template<typename DrawBand>
+    void render(BandCanvas &canvas, DrawBand &&drawBand) {
+        render(canvas, drawBand, UINT32_MAX);
+    }
+
+    /** Redraw at most `maxBands` bands, as render()
+     *
+     * What isn't drawn yet stays in the region for the next call, so that a
+     * large area can be drawn a little at a time.
+     */
+    template<typename DrawBand>
+    void render(BandCanvas &canvas, DrawBand &&drawBand, uint32_t maxBands) {
+        while(numAreas > 0 && maxBands > 0) {
+            Rect &area = areas[numAreas - 1];
+            uint16_t rows = canvas.rowsPerBand(area.width);
+            int16_t h = area.height < rows ? area.height : rows;
+            Rect band = {area.left, area.top, area.width, h};
+            canvas.beginBand(band);
+            drawBand(band);
+            canvas.endBand();
+            area.top += h;
+            area.height -= h;
+            if(area.empty()) {
+                numAreas--;
+            }
+            maxBands--;
+        }
+    }
+
+private:
+    Rect areas[MaxAreas];
+    uint8_t numAreas;
+    bool tracking;
+};
+
+// The changes of one screen between two flushes are a few elements
+using DirtyRegion = BasicDirtyRegion<4>;
+
+} // namespace ui
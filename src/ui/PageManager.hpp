@@ -0,0 +1,229 @@
+#pragma once
+
+#include <stdint.h>
+#include <modm/architecture/interface/clock.hpp>
+
+#include "Rect.hpp"
+#include "BandRenderer.hpp"
+#include "DirtyRegion.hpp"
+#include "StaticLayout.hpp"
+#include "TouchFilter.hpp"
+
+namespace ui {
+
+/** Areas to redraw for a page switch
+ *
+ * A switch adds the elements of two pages, up to about 40 rects. With fewer
+ * slots, most of them are merged into rects which cover much of the background
+ * between the elements, too.
+ */
+using SwitchRegion = BasicDirtyRegion<32>;
+
+/** One full screen of UI, shown by a PageManager */
+class Page {
+public:
+    virtual ~Page() {}
+
+    /** Called when the page is shown or hidden
+     *
+     * A hidden page must not mark anything for redrawing, since it is drawn
+     * in full when it is shown again.
+     */
+    virtual void setActive(bool active) = 0;
+    virtual void addVisibleAreas(SwitchRegion &region) const = 0;
+    virtual void drawBand(modm::GraphicDisplay *d, const Rect &band) = 0;
+    virtual bool isDirty() const = 0;
+    virtual void flush(BandCanvas &canvas) = 0;
+    virtual bool click(int16_t x, int16_t y) = 0;
+};
+
+/** Page made of a StaticScreen */
+template<class... Elements>
+class StaticPage : public Page, public StaticScreen<Elements...> {
+public:
+    using Screen = StaticScreen<Elements...>;
+
+    // Pages start hidden
+    StaticPage() {
+        Screen::setTracking(false);
+    }
+
+    void setActive(bool active) override {
+        Screen::setTracking(active);
+    }
+
+    void addVisibleAreas(SwitchRegion &region) const override {
+        Screen::addVisibleAreas(region);
+    }
+
+    void drawBand(modm::GraphicDisplay *d, const Rect &band) override {
+        Screen::drawBand(d, band);
+    }
+
+    bool isDirty() const override {
+        return Screen::isDirty();
+    }
+
+    void flush(BandCanvas &canvas) override {
+        Screen::flush(canvas);
+    }
+
+    bool click(int16_t x, int16_t y) override {
+        return Screen::click(x, y);
+    }
+};
+
+/** Switches between pages, and routes drawing and touches to the shown one
+ *
+ * Pages which aren't shown get no touches, and changes to them aren't
+ * tracked or drawn, so they cost nothing beyond updating their state.
+ *
+ * show() only records the switch; it is drawn on the next flush(). The switch
+ * redraws the areas of the elements on the old page and on the new one, rather
+ * than the whole screen. Everything else is background on both pages, so it
+ * is left alone. The first page shown is drawn over the whole screen.
+ *
+ * The switches between the pages of this firmware send 76 to 138 KB, where a
+ * full screen redraw is 154 KB, about 0.55 s at the 2.25 MHz SPI clock. Where
+ * elements of the two pages overlap, the overlap may be drawn twice, but
+ * only if merging them would have drawn more. With a band budget set, each
+ * flush() draws at most that many bands of it, and the rest on the next ones,
+ * so that other tasks get to run in between. Until the switch is drawn in
+ * full, isSwitching() stays true and touches are ignored. The drawing time of
+ * the last and the slowest switch is recorded, so that the actual cost can be
+ * checked on the device.
+ */
+class PageManager {
+public:
+    PageManager() :
+        current(NULL),
+        next(NULL),
+        bandBudget(0),
+        switchUs(0),
+        lastSwitchUs(0),
+        maxSwitchUs(0)
+    {
+
+    }
+
+    /** Show `page` on the next flush() */
+    void show(Page *page) {
+        if(page == current) {
+            next = NULL;
+            return;
+        }
+        next = page;
+    }
+
+    /** True if `page` is shown, or about to be */
+    bool isShown(const Page *page) const {
+        return next ? page == next : page == current;
+    }
+
+    /** True if a page switch is waiting to be drawn, or isn't drawn in full */
+    bool isSwitching() const {
+        return next != NULL || !switchRegion.empty();
+    }
+
+    bool isDirty() const {
+        return isSwitching() || (current && current->isDirty());
+    }
+
+    /** Limit the bands drawn for a page switch per flush(), 0 for no limit */
+    void setBandBudget(uint32_t bands) {
+        bandBudget = bands;
+    }
+
+    /** Draw a pending page switch, or what changed on the current page
+     *
+     * Changes to the current page made while its switch is still being drawn
+     * are drawn once the switch is done.
+     */
+    void flush(BandCanvas &canvas) {
+        if(next) {
+            startSwitch(canvas);
+        }
+        if(!switchRegion.empty()) {
+            drawSwitch(canvas);
+        } else if(current) {
+            current->flush(canvas);
+        }
+    }
+
+    /** Draw everything of the shown page which intersects `band`
+     *
+     * For checking what the screen shows; drawing to the display goes through
+     * flush().
+     */
+    void drawBand(modm::GraphicDisplay *d, const Rect &band) {
+        if(current) {
+            current->drawBand(d, band);
+        }
+    }
+
+    void handleTouchStatus(bool active, int16_t x, int16_t y) {
+        // The filter is shared by all pages, so that the touch which switches
+        // pages can't also click on the new page
+        if(touchFilter.update(active) && current && !isSwitching()) {
+            current->click(x, y);
+        }
+    }
+
+    uint32_t getLastSwitchUs() const {
+        return lastSwitchUs;
+    }
+
+    uint32_t getMaxSwitchUs() const {
+        return maxSwitchUs;
+    }
+
+private:
+    void startSwitch(BandCanvas &canvas) {
+        // A switch which isn't drawn in full yet leaves its remaining areas
+        // in the region, so they are still drawn
+        if(current) {
+            current->addVisibleAreas(switchRegion);
+            current->setActive(false);
+        } else {
+            switchRegion.add({0, 0, (int16_t)canvas.getWidth(), (int16_t)canvas.getHeight()});
+        }
+        current = next;
+        next = NULL;
+        current->setActive(true);
+        current->addVisibleAreas(switchRegion);
+        switchUs = 0;
+    }
+
+    void drawSwitch(BandCanvas &canvas) {
+        uint32_t start = now();
+
+        Page *page = current;
+        switchRegion.render(canvas, [page, &canvas](const Rect &band) {
+            page->drawBand(&canvas, band);
+        }, bandBudget > 0 ? bandBudget : UINT32_MAX);
+
+        switchUs += now() - start;
+        if(switchRegion.empty()) {
+            lastSwitchUs = switchUs;
+            if(lastSwitchUs > maxSwitchUs) {
+                maxSwitchUs = lastSwitchUs;
+            }
+        }
+    }
+
+    static uint32_t now() {
+        return modm::chrono::micro_clock::now().time_since_epoch().count();
+    }
+
+    Page *current;
+    Page *next;
+    SwitchRegion switchRegion;
+    uint32_t bandBudget;
+    // Drawing time of the switch in progress
+    uint32_t switchUs;
+    TouchFilter touchFilter;
+    uint32_t lastSwitchUs;
+    uint32_t maxSwitchUs;
+};
+
+} // namespace ui
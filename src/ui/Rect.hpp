@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace ui {
+
+struct Rect {
+    int16_t left;
+    int16_t top;
+    int16_t width;
+    int16_t height;
+
+    int16_t right() const {
+        return left + width;
+    }
+
+    int16_t bottom() const {
+        return top + height;
+    }
+
+    bool empty() const {
+        return width <= 0 || height <= 0;
+    }
+
+    int32_t area() const {
+        return empty() ? 0 : (int32_t)width * height;
+    }
+
+    bool intersects(const Rect &other) const {
+        return left < other.right() && other.left < right() &&
+            top < other.bottom() && other.top < bottom();
+    }
+
+    // True if the rects overlap or share an edge
+    bool touches(const Rect &other) const {
+        return left <= other.right() && other.left <= right() &&
+            top <= other.bottom() && other.top <= bottom();
+    }
+
+    Rect intersection(const Rect &other) const {
+        int16_t l = left > other.left ? left : other.left;
+        int16_t t = top > other.top ? top : other.top;
+        int16_t r = right() < other.right() ? right() : other.right();
+        int16_t b = bottom() < other.bottom() ? bottom() : other.bottom();
+        return {l, t, (int16_t)(r - l), (int16_t)(b - t)};
+    }
+
+    Rect unite(const Rect &other) const {
+        if(empty()) {
+            return other;
+        }
+        if(other.empty()) {
+            return *this;
+        }
+        int16_t l = left < other.left ? left : other.left;
+        int16_t t = top < other.top ? top : other.top;
+        int16_t r = right() > other.right() ? right() : other.right();
+        int16_t b = bottom() > other.bottom() ? bottom() : other.bottom();
+        return {l, t, (int16_t)(r - l), (int16_t)(b - t)};
+    }
+};
+
+} // namespace ui
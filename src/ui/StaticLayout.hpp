@@ -0,0 +1,485 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <string>
+#include <modm/ui/display/graphic_display.hpp>
+#include <modm/architecture/interface/accessor.hpp>
+
+#include "Rect.hpp"
+#include "Digit.hpp"
+#include "BandRenderer.hpp"
+#include "DirtyRegion.hpp"
+#include "TouchFilter.hpp"
+
+namespace ui {
+
+/** Screens declared at compile time
+ *
+ * Each element of a StaticScreen is a type, whose template parameters carry
+ * all of its fixed properties: position, colors, images and click handler.
+ * Those live in code and flash, and drawing and click handling dispatch
+ * statically over the element list. The only RAM used per element is its `State`, which holds
+ * what can change at runtime.
+ *
+ * An element type provides:
+ *
+ *   struct State : ElementState { ... };
+ *   class Handle;   // API for changing the state, usually an ElementHandle
+ *   static Rect rect();
+ *   static void draw(modm::GraphicDisplay *d, const State &s, const Rect &band);
+ *   static void onClick(Handle h, int16_t x, int16_t y);
+ *
+ * Drawing always goes through a BandCanvas; changes only mark areas dirty,
+ * and StaticScreen::flush() draws them.
+ */
+
+// State shared by all elements
+struct ElementState {
+    bool hidden = false;
+};
+
+/** Handle to the state of one element in a StaticScreen
+ *
+ * Returned by StaticScreen::get(), and only meant to be used right away.
+ */
+template<class Element>
+class ElementHandle {
+public:
+    using State = typename Element::State;
+
+    ElementHandle(State &_state, DirtyRegion &_dirty) : state(_state), dirty(_dirty) {}
+
+    void hide() {
+        if(!state.hidden) {
+            state.hidden = true;
+            dirty.add(Element::rect());
+        }
+    }
+
+    void show() {
+        if(state.hidden) {
+            state.hidden = false;
+            dirty.add(Element::rect());
+        }
+    }
+
+    bool isHidden() const {
+        return state.hidden;
+    }
+
+protected:
+    State &state;
+    DirtyRegion &dirty;
+};
+
+// Digit fonts for NumericElement
+struct LargeDigits {
+    static const int16_t Width = Digit::WIDTH;
+    static const int16_t Height = Digit::HEIGHT;
+
+    static void draw(modm::GraphicDisplay *d, int16_t x, int16_t y, uint8_t value, modm::glcd::Color color) {
+        Digit::draw(d, x, y, value, color);
+    }
+};
+
+struct SmallDigits {
+    static const int16_t Width = 16;
+    static const int16_t Height = 32;
+
+    static void draw(modm::GraphicDisplay *d, int16_t x, int16_t y, uint8_t value, modm::glcd::Color color) {
+        d->setFont(modm::font::Numbers14x32);
+        d->setColor(color);
+        d->setCursor({x, y});
+        d->write(value + '0');
+    }
+};
+
+/** Row of N digits
+ *
+ * If `HighlightColor` differs from `Color`, touching a digit makes it the
+ * active digit, which is drawn highlighted.
+ */
+template<int16_t Left, int16_t Top, uint8_t N, uint16_t Color, uint16_t HighlightColor = Color, class Font = LargeDigits>
+struct NumericElement {
+    struct State : ElementState {
+        uint16_t value = 0;
+        int8_t activeDigit = -1;
+    };
+
+    static constexpr Rect rect() {
+        return {Left, Top, Font::Width * N, Font::Height};
+    }
+
+    static constexpr Rect digitRect(uint8_t i) {
+        return {(int16_t)(Left + Font::Width * i), Top, Font::Width, Font::Height};
+    }
+
+    // Value of digit i, counting from the left
+    static uint8_t digitValue(uint16_t value, uint8_t i) {
+        for(uint8_t d = i + 1; d < N; d++) {
+            value /= 10;
+        }
+        return value % 10;
+    }
+
+    class Handle : public ElementHandle<NumericElement> {
+    public:
+        using ElementHandle<NumericElement>::ElementHandle;
+
+        void setValue(uint16_t value) {
+            // Only the digits which change are redrawn
+            for(uint8_t i = 0; i < N; i++) {
+                if(digitValue(value, i) != digitValue(this->state.value, i)) {
+                    this->dirty.add(digitRect(i));
+                }
+            }
+            this->state.value = value;
+        }
+
+        uint16_t getValue() const {
+            return this->state.value;
+        }
+
+        void setActiveDigit(int8_t digit) {
+            if(digit == this->state.activeDigit) {
+                return;
+            }
+            if(this->state.activeDigit >= 0 && this->state.activeDigit < N) {
+                this->dirty.add(digitRect(this->state.activeDigit));
+            }
+            this->state.activeDigit = digit;
+            if(digit >= 0 && digit < N) {
+                this->dirty.add(digitRect(digit));
+            }
+        }
+
+        int8_t getActiveDigit() const {
+            return this->state.activeDigit;
+        }
+    };
+
+    static void draw(modm::GraphicDisplay *d, const State &s, const Rect &band) {
+        for(uint8_t i = 0; i < N; i++) {
+            if(band.intersects(digitRect(i))) {
+                modm::glcd::Color c(i == s.activeDigit ? HighlightColor : Color);
+                Font::draw(d, Left + Font::Width * i, Top, digitValue(s.value, i), c);
+            }
+        }
+    }
+
+    static void onClick(Handle h, int16_t x, int16_t y) {
+        (void)y;
+        if constexpr (HighlightColor != Color) {
+            h.setActiveDigit((x - Left) / Font::Width);
+        }
+    }
+};
+
+/** Button showing an RGB565 image from images/, calling `OnClick` when touched */
+template<int16_t Left, int16_t Top, const uint16_t *Image, int16_t Padding = 0, void (*OnClick)() = nullptr>
+struct ImageButtonElement {
+    struct State : ElementState {};
+
+    using Handle = ElementHandle<ImageButtonElement>;
+
+    // Image size is stored in the first two words of the image
+    static Rect rect() {
+        return {Left, Top, (int16_t)(Image[0] + Padding * 2), (int16_t)(Image[1] + Padding * 2)};
+    }
+
+    static void draw(modm::GraphicDisplay *d, const State &s, const Rect &band) {
+        (void)s;
+        (void)band;
+        d->drawBitmap(
+            {(int16_t)(Left + Padding), (int16_t)(Top + Padding)},
+            Image[0],
+            Image[1],
+            modm::accessor::asFlash<uint8_t>((const uint8_t*)&Image[2])
+        );
+    }
+
+    static void onClick(Handle h, int16_t x, int16_t y) {
+        (void)h;
+        (void)x;
+        (void)y;
+        if constexpr (OnClick != nullptr) {
+            OnClick();
+        }
+    }
+};
+
+/** Line of fixed text in the 5x8 font */
+template<int16_t Left, int16_t Top, const char *Text, uint16_t Color>
+struct LabelElement {
+    struct State : ElementState {};
+
+    using Handle = ElementHandle<LabelElement>;
+
+    static constexpr int16_t CharWidth = 6;
+    static constexpr int16_t CharHeight = 8;
+
+    static constexpr Rect rect() {
+        return {Left, Top, (int16_t)(CharWidth * std::char_traits<char>::length(Text)), CharHeight};
+    }
+
+    static void draw(modm::GraphicDisplay *d, const State &s, const Rect &band) {
+        (void)s;
+        (void)band;
+        d->setFont(modm::font::FixedWidth5x8);
+        d->setColor(modm::glcd::Color(Color));
+        d->setCursor({Left, Top});
+        *d << Text;
+    }
+
+    static void onClick(Handle h, int16_t x, int16_t y) {
+        (void)h;
+        (void)x;
+        (void)y;
+    }
+};
+
+/** Outlined button with a text label, calling `OnClick` when touched */
+template<int16_t Left, int16_t Top, int16_t Width, int16_t Height, const char *Text, uint16_t Color, void (*OnClick)()>
+struct TextButtonElement {
+    using Label = LabelElement<0, 0, Text, Color>;
+
+    struct State : ElementState {};
+
+    using Handle = ElementHandle<TextButtonElement>;
+
+    static constexpr Rect rect() {
+        return {Left, Top, Width, Height};
+    }
+
+    static void draw(modm::GraphicDisplay *d, const State &s, const Rect &band) {
+        (void)s;
+        (void)band;
+        d->setColor(modm::glcd::Color(Color));
+        d->drawRectangle({Left, Top}, Width, Height);
+        d->setFont(modm::font::FixedWidth5x8);
+        d->setCursor({
+            (int16_t)(Left + (Width - Label::rect().width) / 2),
+            (int16_t)(Top + (Height - Label::CharHeight) / 2)
+        });
+        *d << Text;
+    }
+
+    static void onClick(Handle h, int16_t x, int16_t y) {
+        (void)h;
+        (void)x;
+        (void)y;
+        OnClick();
+    }
+};
+
+/** Strip chart of a setpoint and a measured value over the last `Width` samples
+ *
+ * The chart sweeps like an oscilloscope: each new sample overwrites the oldest
+ * column in place, and a blank column ahead of it marks the write position.
+ * A sample only redraws those two columns, i.e. 4 * Height bytes over SPI,
+ * instead of shifting the whole chart.
+ *
+ * Values are plotted from 0 at the bottom to the full scale at the top, and
+ * changing the full scale redraws the whole chart.
+ */
+template<int16_t Left, int16_t Top, int16_t Width, int16_t Height, uint16_t SetpointColor, uint16_t MeasuredColor>
+struct TrendChartElement {
+    struct State : ElementState {
+        uint16_t setpoint[Width] = {};
+        uint16_t measured[Width] = {};
+        // Column the next sample goes to
+        uint16_t next = 0;
+        // Number of columns with data
+        uint16_t count = 0;
+        uint16_t fullScale = 1000;
+    };
+
+    static constexpr Rect rect() {
+        return {Left, Top, Width, Height};
+    }
+
+    class Handle : public ElementHandle<TrendChartElement> {
+    public:
+        using ElementHandle<TrendChartElement>::ElementHandle;
+
+        void push(uint16_t setpoint, uint16_t measured) {
+            State &s = this->state;
+            uint16_t column = s.next;
+            s.setpoint[column] = setpoint;
+            s.measured[column] = measured;
+            s.next = (column + 1) % Width;
+            if(s.count < Width) {
+                s.count++;
+            }
+            this->dirty.add({(int16_t)(Left + column), Top, 1, Height});
+            this->dirty.add({(int16_t)(Left + s.next), Top, 1, Height});
+        }
+
+        /** Remove all samples, e.g. at the start of a run */
+        void clear() {
+            this->state.next = 0;
+            this->state.count = 0;
+            this->dirty.add(rect());
+        }
+
+        void setFullScale(uint16_t fullScale) {
+            if(fullScale != this->state.fullScale && fullScale > 0) {
+                this->state.fullScale = fullScale;
+                this->dirty.add(rect());
+            }
+        }
+    };
+
+    static void draw(modm::GraphicDisplay *d, const State &s, const Rect &band) {
+        Rect r = rect().intersection(band);
+        for(int16_t x = r.left; x < r.right(); x++) {
+            uint16_t column = x - Left;
+            // The write position and columns not yet filled stay blank
+            if(column == s.next || column >= s.count) {
+                continue;
+            }
+            int16_t y = valueToY(s, s.measured[column]);
+            int16_t prevY = y;
+            uint16_t prev = (column + Width - 1) % Width;
+            if(prev != s.next && prev < s.count) {
+                prevY = valueToY(s, s.measured[prev]);
+            }
+            // Join to the previous sample, so that steps show as lines
+            d->setColor(modm::glcd::Color(MeasuredColor));
+            d->drawVerticalLine({x, prevY < y ? prevY : y}, (prevY < y ? y - prevY : prevY - y) + 1);
+            d->setColor(modm::glcd::Color(SetpointColor));
+            d->setPixel(x, valueToY(s, s.setpoint[column]));
+        }
+    }
+
+    static void onClick(Handle h, int16_t x, int16_t y) {
+        (void)h;
+        (void)x;
+        (void)y;
+    }
+
+private:
+    static int16_t valueToY(const State &s, uint16_t value) {
+        if(value > s.fullScale) {
+            value = s.fullScale;
+        }
+        return Top + Height - 1 - (int32_t)value * (Height - 1) / s.fullScale;
+    }
+};
+
+/** A screen made up of a fixed list of element types */
+template<class... Elements>
+class StaticScreen {
+public:
+    /** Get the handle for changing the state of element `E` */
+    template<class E>
+    typename E::Handle get() {
+        return typename E::Handle(std::get<indexOf<E>()>(states), dirty);
+    }
+
+    /** Mark the whole screen for redrawing */
+    void invalidate(const Rect &screen) {
+        dirty.add(screen);
+    }
+
+    bool isDirty() const {
+        return !dirty.empty();
+    }
+
+    /** Draw everything that changed */
+    void flush(BandCanvas &canvas) {
+        dirty.render(canvas, [this, &canvas](const Rect &band) {
+            drawBand(&canvas, band);
+        });
+    }
+
+    void handleTouchStatus(bool active, int16_t x, int16_t y) {
+        if(touchFilter.update(active)) {
+            click(x, y);
+        }
+    }
+
+    /** Pass a click to the first visible element under it
+     *
+     * @return true if an element took the click
+     */
+    bool click(int16_t x, int16_t y) {
+        return click(x, y, std::index_sequence_for<Elements...>{});
+    }
+
+    /** Draw all visible elements which intersect `band` */
+    void drawBand(modm::GraphicDisplay *d, const Rect &band) {
+        drawBand(d, band, std::index_sequence_for<Elements...>{});
+    }
+
+    /** Add the area of every visible element to `region` */
+    template<class Region>
+    void addVisibleAreas(Region &region) const {
+        addVisibleAreas(region, std::index_sequence_for<Elements...>{});
+    }
+
+    /** Stop or restart tracking changes
+     *
+     * While stopped, state changes are still kept, but nothing is marked for
+     * redrawing; the screen must be redrawn in full when it is shown again.
+     */
+    void setTracking(bool enable) {
+        dirty.setTracking(enable);
+    }
+
+private:
+    template<class E>
+    static constexpr size_t indexOf() {
+        size_t index = sizeof...(Elements);
+        size_t i = 0;
+        ((std::is_same_v<E, Elements> ? (index = i, ++i) : ++i), ...);
+        static_assert(((std::is_same_v<E, Elements> ? 1 : 0) + ...) == 1,
+            "Element must appear in the screen exactly once");
+        return index;
+    }
+
+    template<size_t... I>
+    void drawBand(modm::GraphicDisplay *d, const Rect &band, std::index_sequence<I...>) {
+        (drawElement<Elements, I>(d, band), ...);
+    }
+
+    template<class E, size_t I>
+    void drawElement(modm::GraphicDisplay *d, const Rect &band) {
+        const auto &s = std::get<I>(states);
+        if(!s.hidden && band.intersects(E::rect())) {
+            E::draw(d, s, band);
+        }
+    }
+
+    template<class Region, size_t... I>
+    void addVisibleAreas(Region &region, std::index_sequence<I...>) const {
+        ((std::get<I>(states).hidden ? void() : region.add(Elements::rect())), ...);
+    }
+
+    // Only the first visible element under the touch gets the click
+    template<size_t... I>
+    bool click(int16_t x, int16_t y, std::index_sequence<I...>) {
+        return (clickElement<Elements, I>(x, y) || ...);
+    }
+
+    template<class E, size_t I>
+    bool clickElement(int16_t x, int16_t y) {
+        auto &s = std::get<I>(states);
+        Rect r = E::rect();
+        if(!s.hidden && x > r.left && x < r.right() && y > r.top && y < r.bottom()) {
+            E::onClick(typename E::Handle(s, dirty), x, y);
+            return true;
+        }
+        return false;
+    }
+
+    std::tuple<typename Elements::State...> states;
+    DirtyRegion dirty;
+    TouchFilter touchFilter;
+};
+
+} // namespace ui
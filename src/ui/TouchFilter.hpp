@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace ui {
+
+/** Turns the raw touch state into single click events
+ *
+ * A click is reported on the transition to pressed. After a release, the touch
+ * must stay released for a number of polls before another click is accepted,
+ * which suppresses bounce from a light touch.
+ */
+class TouchFilter {
+public:
+    TouchFilter() : touchActive(false), debounceCounter(0) {}
+
+    /** Update with the current touch state
+     *
+     * @return true if this is a new click
+     */
+    bool update(bool active) {
+        bool click = !touchActive && active && debounceCounter == 0;
+        touchActive = active;
+        if(active) {
+            debounceCounter = DebouncePolls;
+        }
+        if(!active && debounceCounter > 0) {
+            debounceCounter--;
+        }
+        return click;
+    }
+
+private:
+    static const uint8_t DebouncePolls = 25;
+
+    bool touchActive;
+    uint8_t debounceCounter;
+};
+
+} // namespace ui
@@ -55,6 +55,12 @@ public:
 		return z1 + 4095 - z2;
 	}
 
+	/**
+	 * Average the two closest of three readings.
+	 */
+	static uint16_t
+	getBestTwo(uint16_t *temp);
+
 private:
 	static const uint8_t CHX = 0x90;
 	static const uint8_t CHY = 0xd0;
@@ -63,9 +69,6 @@ private:
 
 	static const uint16_t defaultThreshold = 72;
 
-	static uint16_t
-	getBestTwo(uint16_t *temp);
-
 	static uint16_t
 	readData(uint8_t command);
 };
@@ -0,0 +1,203 @@
+/** Tests for the block autocorrelation period estimator
+ *
+ * Runs pulse trains from 260 to 9000 RPM through BlockPeriodEstimator, with
+ * heavy noise, with narrow and wide pulses, and with strong harmonics, and
+ * checks every estimate against the period generated. Also checks that the
+ * correlation of full-scale blocks, the worst case for its 32-bit
+ * accumulator, comes out exact.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "check.hpp"
+#include "BlockPeriodEstimator.hpp"
+
+using Estimator = BlockPeriodEstimator<512, 128, 4, 240>;
+
+/** Small deterministic generator, so every run sees the same noise */
+class Lcg {
+public:
+    explicit Lcg(uint32_t seed) : state(seed) {}
+
+    float uniform() {
+        state = state * 1664525u + 1013904223u;
+        return ((state >> 8) + 0.5f) / 16777216.0f;
+    }
+
+    float gauss(float sigma) {
+        return sigma * sqrtf(-2.0f * logf(uniform())) * cosf(2.0f * (float)M_PI * uniform());
+    }
+
+private:
+    uint32_t state;
+};
+
+/** Signal level over one revolution, for phase in [0, 1) */
+typedef float (*Shape)(float phase);
+
+struct Case {
+    const char *name;
+    Shape shape;
+    // Counts for a level of 1
+    float amplitude;
+    float noise;
+    // Shortest period with every part of the shape at least a sample long
+    float minPeriod;
+};
+
+static float pulse30(float phase) {
+    return phase < 0.3f ? 1.0f : 0.0f;
+}
+
+// A narrow strip of tape
+static float pulse5(float phase) {
+    return phase < 0.05f ? 1.0f : 0.0f;
+}
+
+// Tape over most of the circumference, leaving a narrow gap
+static float pulse90(float phase) {
+    return phase < 0.9f ? 1.0f : 0.0f;
+}
+
+// Fundamental with strong second and third harmonics, as from a reflector
+// which isn't flat
+static float harmonics(float phase) {
+    float w = 2.0f * (float)M_PI * phase;
+    return 0.5f + 0.25f * sinf(w) + 0.2f * sinf(2.0f * w + 0.5f) + 0.15f * sinf(3.0f * w + 1.0f);
+}
+
+// A second, weaker piece of tape half a revolution on
+static float twoPulses(float phase) {
+    if(phase < 0.2f) {
+        return 1.0f;
+    }
+    if(phase >= 0.5f && phase < 0.6f) {
+        return 0.4f;
+    }
+    return 0.0f;
+}
+
+static const Case Cases[] = {
+    {"clean", pulse30, 600.0f, 5.0f, 0.0f},
+    // Noise a quarter of the pulse, where the edge detector chatters and
+    // reads 1.1 to 20 times the speed
+    {"low snr", pulse30, 300.0f, 75.0f, 0.0f},
+    {"narrow", pulse5, 600.0f, 60.0f, 20.0f},
+    {"wide", pulse90, 600.0f, 60.0f, 10.0f},
+    {"harmonics", harmonics, 1200.0f, 60.0f, 0.0f},
+    {"two pulses", twoPulses, 600.0f, 60.0f, 10.0f},
+};
+
+// Periods in samples, from 9000 to 260 RPM at 1 kHz
+static const float Periods[] = {6.67f, 10.17f, 20.37f, 47.7f, 101.3f, 170.9f, 230.8f};
+
+// Estimates must be this close to the period generated
+static const float MaxError = 0.02f;
+
+bool testAccuracy() {
+    bool ok = true;
+    printf("%-11s", "");
+    for(float period : Periods) {
+        printf(" %7.2f", period);
+    }
+    printf("   samples per revolution, worst error\n");
+    for(const Case &c : Cases) {
+        printf("%-11s", c.name);
+        for(float period : Periods) {
+            if(period < c.minPeriod) {
+                printf(" %7s", "-");
+                continue;
+            }
+            Lcg rng(7);
+            Estimator estimator;
+            float worst = 0.0f;
+            uint32_t estimates = 0;
+            uint32_t missing = 0;
+            float phase = rng.uniform();
+            for(uint32_t i = 0; i < 4096; i++) {
+                float v = 1500.0f + c.amplitude * c.shape(fmodf(i / period + phase, 1.0f)) + rng.gauss(c.noise);
+                if(estimator.push((uint16_t)fminf(fmaxf(v, 0.0f), 4095.0f))) {
+                    estimates++;
+                    float estimate = estimator.getPeriod();
+                    if(estimate == 0.0f) {
+                        missing++;
+                    } else {
+                        worst = fmaxf(worst, fabsf(estimate / period - 1.0f));
+                    }
+                }
+            }
+            printf(" %6.2f%%", worst * 100.0f);
+            if(missing > 0) {
+                printf("\n%s at %.2f samples: no estimate %u of %u times\n", c.name, period,
+                    (unsigned)missing, (unsigned)estimates);
+                ok = false;
+            }
+            if(worst > MaxError) {
+                ok = false;
+            }
+        }
+        printf("\n");
+    }
+    CHECK(ok);
+    return true;
+}
+
+/** No signal: no confident estimate */
+bool testNoiseOnly() {
+    Lcg rng(3);
+    Estimator estimator;
+    uint32_t estimates = 0;
+    for(uint32_t i = 0; i < 8192; i++) {
+        if(estimator.push((uint16_t)(2000.0f + rng.gauss(50.0f))) && estimator.getPeriod() != 0.0f) {
+            estimates++;
+        }
+    }
+    CHECK(estimates == 0);
+    return true;
+}
+
+/** After DC removal and halving, samples are within ±2047, so a full window
+ * of them summed can just not overflow. Checks that against a 64-bit sum, at
+ * the largest magnitude in both signs.
+ */
+bool testAccumulatorRange() {
+    static int16_t high[512];
+    static int16_t low[512];
+    for(uint32_t i = 0; i < 512; i++) {
+        high[i] = 2047;
+        low[i] = -2047;
+    }
+    int64_t most = (int64_t)2047 * 2047 * 512;
+    CHECK(most <= INT32_MAX);
+    CHECK(Estimator::correlate(high, high, 512) == most);
+    CHECK(Estimator::correlate(low, low, 512) == most);
+    CHECK(Estimator::correlate(high, low, 512) == -most);
+    // An odd length, so the tail after the packed pairs is covered too
+    CHECK(Estimator::correlate(high, low + 1, 511) == -(int64_t)2047 * 2047 * 511);
+
+    // The most the samples can deviate from their mean is when it sits at
+    // one end of the range: a single full-scale pulse per window. The
+    // estimator must take that without its zero lag energy wrapping.
+    Estimator estimator;
+    for(uint32_t i = 0; i < 4096; i++) {
+        bool pulse = i % 256 < 2;
+        if(estimator.push(pulse ? 4095 : 0)) {
+            CHECK(estimator.getConfidence() <= 256);
+        }
+    }
+    CHECK(fabsf(estimator.getPeriod() - 256.0f) < 1.0f || estimator.getPeriod() == 0.0f);
+    return true;
+}
+
+int main() {
+    bool ok = testAccuracy();
+    ok = testNoiseOnly() && ok;
+    ok = testAccumulatorRange() && ok;
+    if(ok) {
+        printf("all periods within %.0f%%\n", MaxError * 100.0f);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdio.h>
+
+/** Fail the enclosing test function, which returns bool, if `cond` is false,
+ * and print where
+ */
+#define CHECK(cond) do { \
+    if(!(cond)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        return false; \
+    } \
+} while(0)
@@ -0,0 +1,105 @@
+/** Tests for the DShot frame encoding
+ *
+ * Checks encodeFrame() against frames worked out by hand from the protocol,
+ * the checksum of every throttle value, the timer compare values written for
+ * each bit, and the pulse width to throttle mapping.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "check.hpp"
+#include "DShotFrame.hpp"
+
+using namespace dshot;
+
+struct KnownFrame {
+    uint16_t throttle;
+    bool telemetry;
+    uint16_t frame;
+};
+
+// Throttle in the top 11 bits, then the telemetry bit, then the XOR of the
+// three nibbles above as checksum
+static const KnownFrame KnownFrames[] = {
+    {0, false, 0x0000},
+    {0, true, 0x0011},
+    {1, false, 0x0022},
+    {48, false, 0x0606},
+    {1046, false, 0x82c6},
+    {1046, true, 0x82d7},
+    {2047, false, 0xffee},
+};
+
+bool testKnownFrames() {
+    for(const KnownFrame &k : KnownFrames) {
+        uint16_t frame = encodeFrame(k.throttle, k.telemetry);
+        if(frame != k.frame) {
+            printf("throttle %u telemetry %u: 0x%04x, expected 0x%04x\n",
+                (unsigned)k.throttle, (unsigned)k.telemetry, (unsigned)frame, (unsigned)k.frame);
+        }
+        CHECK(frame == k.frame);
+    }
+    return true;
+}
+
+bool testAllThrottles() {
+    for(uint16_t throttle = 0; throttle <= MaxThrottle; throttle++) {
+        for(int telemetry = 0; telemetry < 2; telemetry++) {
+            uint16_t frame = encodeFrame(throttle, telemetry);
+            CHECK(frame >> 5 == throttle);
+            CHECK(((frame >> 4) & 1) == telemetry);
+            // The nibbles of a valid frame XOR to 0
+            CHECK(((frame ^ (frame >> 4) ^ (frame >> 8) ^ (frame >> 12)) & 0xf) == 0);
+        }
+    }
+    return true;
+}
+
+bool testBitBuffer() {
+    // DShot600 at 170 MHz: 283 ticks per bit
+    const uint16_t one = 212;
+    const uint16_t zero = 106;
+    // 0x82c6, most significant bit first, then two idle bits
+    const uint16_t expected[FrameBits + 2] = {
+        one, zero, zero, zero, zero, zero, one, zero,
+        one, one, zero, zero, zero, one, one, zero,
+        0, 0
+    };
+    uint16_t buf[FrameBits + 3];
+    buf[FrameBits + 2] = 0xbeef;
+    fillBitBuffer(encodeFrame(1046), buf, one, zero, 2);
+    for(uint32_t i = 0; i < FrameBits + 2; i++) {
+        CHECK(buf[i] == expected[i]);
+    }
+    // Nothing written past the idle bits
+    CHECK(buf[FrameBits + 2] == 0xbeef);
+    return true;
+}
+
+bool testPulseWidth() {
+    CHECK(throttleFromPulseWidth(0) == 0);
+    CHECK(throttleFromPulseWidth(1000) == 0);
+    CHECK(throttleFromPulseWidth(1001) == MinThrottle + 1);
+    CHECK(throttleFromPulseWidth(1050) == 147);
+    CHECK(throttleFromPulseWidth(1999) == 2045);
+    CHECK(throttleFromPulseWidth(2000) == MaxThrottle);
+    CHECK(throttleFromPulseWidth(2500) == MaxThrottle);
+    // Never a special command once running
+    for(uint32_t width = 1001; width < 2000; width++) {
+        CHECK(throttleFromPulseWidth(width) >= MinThrottle);
+        CHECK(throttleFromPulseWidth(width) >= throttleFromPulseWidth(width - 1));
+    }
+    return true;
+}
+
+int main() {
+    bool ok = testKnownFrames();
+    ok = testAllThrottles() && ok;
+    ok = testBitBuffer() && ok;
+    ok = testPulseWidth() && ok;
+    if(ok) {
+        printf("all frames and bit buffers as expected\n");
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,164 @@
+/** Tests for the period jitter alarms
+ *
+ * Runs tach waveforms with steady periods from 5.5 to 60 samples per
+ * revolution (about 11000 to 1000 RPM) through TachDetector, with sharp edges,
+ * which are only timed to the sample, and with edges ramping over a few
+ * samples, and checks that sampling and signal noise alone never raise a
+ * jitter alarm. Then checks that real period variation, random and periodic,
+ * still does.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "check.hpp"
+#include "TachDetector.hpp"
+
+using Detector = TachDetector<TachDetectorConfig>;
+
+/** Small deterministic generator, so every run sees the same noise */
+class Lcg {
+public:
+    explicit Lcg(uint32_t seed) : state(seed) {}
+
+    float uniform() {
+        state = state * 1664525u + 1013904223u;
+        return ((state >> 8) + 0.5f) / 16777216.0f;
+    }
+
+    float gauss(float sigma) {
+        return sigma * sqrtf(-2.0f * logf(uniform())) * cosf(2.0f * (float)M_PI * uniform());
+    }
+
+private:
+    uint32_t state;
+};
+
+/** Alarms of the blocks of a run, and how many blocks were judged */
+struct Alarms {
+    uint32_t blocks;
+    uint8_t alarms;
+    float worstStdDevPermille;
+};
+
+/** Pulses with 30% duty starting at `edges`, each edge ramping over `ramp`
+ * samples (0 for a step), with noise of `noise` counts
+ */
+static Alarms run(const std::vector<float> &edges, float ramp, float noise, uint32_t seed) {
+    Lcg rng(seed);
+    Detector detector;
+    Alarms result = {0, 0, 0.0f};
+    uint32_t blocks = 0;
+    uint32_t k = 0;
+    uint32_t length = (uint32_t)edges.back();
+    for(uint32_t i = 0; i < length; i++) {
+        while(edges[k + 1] <= i) {
+            k++;
+        }
+        float t = i - edges[k];
+        float high = 0.3f * (edges[k + 1] - edges[k]);
+        float level;
+        if(ramp > 0.0f) {
+            level = fminf(t / ramp, 1.0f) - fminf(fmaxf((t - high) / ramp, 0.0f), 1.0f);
+        } else {
+            level = t < high ? 1.0f : 0.0f;
+        }
+        detector.processSample((uint16_t)(1600.0f + 800.0f * level + rng.gauss(noise)));
+
+        const Detector::Analytics &analytics = detector.getPeriodAnalytics();
+        if(analytics.getBlocks() != blocks) {
+            blocks = analytics.getBlocks();
+            // The first block starts with the detector settling
+            if(blocks > 1) {
+                const Detector::Analytics::Result &r = analytics.getResult();
+                result.blocks++;
+                result.alarms |= r.alarms;
+                result.worstStdDevPermille = fmaxf(result.worstStdDevPermille, r.stdDev / r.mean * 1000.0f);
+            }
+        }
+    }
+    return result;
+}
+
+/** Edges of `revolutions` periods, each from `period(n)` */
+template<class Period>
+static std::vector<float> makeEdges(uint32_t revolutions, Period period) {
+    std::vector<float> edges;
+    float t = 3.7f;
+    for(uint32_t n = 0; n <= revolutions; n++) {
+        edges.push_back(t);
+        t += period(n);
+    }
+    return edges;
+}
+
+// Enough revolutions for three judged blocks of 64
+static const uint32_t Revolutions = 64 * 4 + 8;
+
+bool testSteadyRaisesNoAlarm() {
+    float worst = 0.0f;
+    uint32_t runs = 0;
+    for(float period = 5.5f; period < 60.0f; period += 0.0731f) {
+        std::vector<float> edges = makeEdges(Revolutions, [=](uint32_t) {
+            return period;
+        });
+        for(float ramp : {0.0f, 3.0f}) {
+            Alarms a = run(edges, ramp, ramp > 0.0f ? 4.0f : 2.0f, runs);
+            runs++;
+            if(a.alarms != 0 || a.blocks < 3) {
+                printf("period %.3f samples, ramp %.0f: alarms %u in %u blocks\n",
+                    period, ramp, (unsigned)a.alarms, (unsigned)a.blocks);
+            }
+            CHECK(a.blocks >= 3);
+            CHECK(a.alarms == 0);
+            worst = fmaxf(worst, a.worstStdDevPermille);
+        }
+    }
+    printf("%u steady runs, no alarms, worst standard deviation %.1f per mille\n", (unsigned)runs, worst);
+    return true;
+}
+
+/** 10.17 samples per revolution, the case of 5900 RPM with sharp edges */
+bool testSharpEdgesAt5900Rpm() {
+    std::vector<float> edges = makeEdges(Revolutions, [](uint32_t) {
+        return 10.17f;
+    });
+    Alarms a = run(edges, 0.0f, 2.0f, 1);
+    printf("5900 RPM, sharp edges: standard deviation %.1f per mille\n", a.worstStdDevPermille);
+    // Well over the 15 per mille limit, all of it from sampling
+    CHECK(a.worstStdDevPermille > 30.0f);
+    CHECK(a.alarms == 0);
+    return true;
+}
+
+bool testVariationRaisesAlarm() {
+    Lcg rng(99);
+    // 1000 RPM, with 4% of random period variation
+    std::vector<float> edges = makeEdges(Revolutions, [&](uint32_t) {
+        return 60.0f * (1.0f + rng.gauss(0.04f));
+    });
+    Alarms a = run(edges, 3.0f, 4.0f, 2);
+    CHECK(a.alarms & Detector::Analytics::StdDevAlarm);
+    CHECK(a.alarms & Detector::Analytics::PeakToPeakAlarm);
+
+    // 3000 RPM, with the period swinging by 5% every 32 revolutions, as from
+    // a wafer walking on the chuck
+    edges = makeEdges(Revolutions, [](uint32_t n) {
+        return 20.0f * (1.0f + 0.05f * sinf(2.0f * (float)M_PI * n / 32));
+    });
+    a = run(edges, 3.0f, 4.0f, 3);
+    CHECK(a.alarms & Detector::Analytics::HarmonicAlarm);
+    return true;
+}
+
+int main() {
+    bool ok = testSteadyRaisesNoAlarm();
+    ok = testSharpEdgesAt5900Rpm() && ok;
+    ok = testVariationRaisesAlarm() && ok;
+    if(ok) {
+        printf("alarms on period variation only\n");
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
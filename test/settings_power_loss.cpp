@@ -0,0 +1,296 @@
+/** Power loss test for the settings store
+ *
+ * Runs SettingsStore on the emulated flash and cuts the power at every flash
+ * operation of a fixed workload in turn, and then at random points over many
+ * boots in a row, including during the cleanup after a boot. A cut operation
+ * is left torn: half a double-word programmed, or half a page erased. After
+ * each cut, the store is booted again, and every key must read back the last
+ * value whose write completed, or the value whose write was cut. All of it is
+ * run again with the torn double-words failing their ECC check, and zeroed
+ * when read, as the NMI handler does on the G4.
+ *
+ * Also checks that a write finding the active page full is held until the
+ * compaction is done, instead of running the compaction from `set()`.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "check.hpp"
+#include "settings/SettingsStore.hpp"
+#include "settings/EmulatedFlashBackend.hpp"
+
+using namespace settings;
+
+static const uint32_t NumKeys = (uint32_t)Key::NumKeys;
+
+// Small deterministic generator, so that failures can be reproduced
+struct Random {
+    uint32_t state;
+
+    uint32_t next() {
+        state = state * 1664525 + 1013904223;
+        return state >> 8;
+    }
+};
+
+// What the store must hold: the last value of each key whose write completed,
+// and the value of each key held in RAM while the active page was full
+struct Model {
+    bool has[NumKeys];
+    uint32_t value[NumKeys];
+    bool pending[NumKeys];
+    uint32_t pendingValue[NumKeys];
+
+    void clear() {
+        for(uint32_t k = 0; k < NumKeys; k++) {
+            has[k] = false;
+            pending[k] = false;
+        }
+    }
+
+    void set(uint32_t key, uint32_t v) {
+        has[key] = true;
+        value[key] = v;
+        pending[key] = false;
+    }
+
+    /** Follow a write the store accepted, which it may have held */
+    template<class Store>
+    void accept(const Store &store, uint32_t key, uint32_t v) {
+        if(store.isPending((Key)key)) {
+            pending[key] = true;
+            pendingValue[key] = v;
+        } else {
+            set(key, v);
+        }
+    }
+
+    /** Follow held writes that the store has since written */
+    template<class Store>
+    void update(const Store &store) {
+        for(uint32_t k = 0; k < NumKeys; k++) {
+            if(pending[k] && !store.isPending((Key)k)) {
+                set(k, pendingValue[k]);
+            }
+        }
+    }
+};
+
+// Write that was in progress when the power went, if any
+struct InFlight {
+    bool active;
+    uint32_t key;
+    uint32_t value;
+};
+
+/** Check the booted store against the model
+ *
+ * A cut write may or may not have made it, so either outcome is taken, and
+ * the model follows what the store holds. So is a held write, which the store
+ * may have been writing when the power went.
+ */
+template<class Store>
+bool checkStore(const Store &store, Model &model, const InFlight &inFlight) {
+    for(uint32_t k = 0; k < NumKeys; k++) {
+        uint32_t v;
+        bool found = store.get((Key)k, v);
+        bool pending = model.pending[k];
+        model.pending[k] = false;
+        if(inFlight.active && inFlight.key == k && found && v == inFlight.value) {
+            model.set(k, v);
+            continue;
+        }
+        if(pending && found && v == model.pendingValue[k]) {
+            model.set(k, v);
+            continue;
+        }
+        if(model.has[k]) {
+            CHECK(found);
+            CHECK(v == model.value[k]);
+        } else {
+            CHECK(!found);
+        }
+    }
+    return true;
+}
+
+/** Write random values until `numWrites` are done, or the power goes
+ *
+ * Background compaction steps run between the writes, as from the settings
+ * task.
+ */
+template<class Flash, class Store>
+void runWrites(Store &store, Model &model, InFlight &inFlight, Random &random, uint32_t numWrites) {
+    inFlight.active = false;
+    for(uint32_t i = 0; i < numWrites && !Flash::isPowerOff(); i++) {
+        uint32_t key = random.next() % NumKeys;
+        uint32_t value = random.next();
+        if(store.set((Key)key, value)) {
+            model.accept(store, key, value);
+        } else {
+            inFlight = {true, key, value};
+            return;
+        }
+        uint32_t steps = random.next() % 3;
+        for(uint32_t j = 0; j < steps; j++) {
+            store.task();
+            model.update(store);
+        }
+    }
+}
+
+/** True while the store has a compaction or held writes to finish */
+template<class Store>
+bool isBusy(const Store &store) {
+    for(uint32_t k = 0; k < NumKeys; k++) {
+        if(store.isPending((Key)k)) {
+            return true;
+        }
+    }
+    return store.isCompacting();
+}
+
+/** Cut the power at each flash operation of the same workload in turn */
+template<class Flash>
+bool testEveryCutPoint(uint32_t numWrites, uint32_t &cutPoints) {
+    for(uint32_t cut = 0; ; cut++) {
+        Flash::reset();
+        Model model;
+        model.clear();
+        InFlight inFlight;
+        Random random = {cut};
+        {
+            SettingsStore<Flash> store;
+            store.initialize();
+            Random workload = {12345};
+            Flash::cutPowerAfter(cut);
+            runWrites<Flash>(store, model, inFlight, workload, numWrites);
+        }
+        if(!Flash::isPowerOff()) {
+            // The workload finished before the cut, so every point was tried
+            cutPoints += cut;
+            return true;
+        }
+        Flash::restorePower();
+
+        SettingsStore<Flash> store;
+        store.initialize();
+        CHECK(checkStore(store, model, inFlight));
+
+        // The store must still work after the recovery, and keep its values
+        runWrites<Flash>(store, model, inFlight, random, 3 * NumKeys);
+        CHECK(!inFlight.active);
+        while(isBusy(store)) {
+            CHECK(store.task());
+            model.update(store);
+        }
+        SettingsStore<Flash> rebooted;
+        rebooted.initialize();
+        CHECK(checkStore(rebooted, model, inFlight));
+    }
+}
+
+/** Boot over and over, each time cutting the power at a random point */
+template<class Flash>
+bool testRandomCuts(uint32_t seed, uint32_t boots) {
+    Flash::reset();
+    Model model;
+    model.clear();
+    InFlight inFlight = {false, 0, 0};
+    Random random = {seed};
+    for(uint32_t boot = 0; boot < boots; boot++) {
+        SettingsStore<Flash> store;
+        // The cut can come during the boot's own cleanup, too
+        Flash::cutPowerAfter(random.next() % 200);
+        store.initialize();
+        CHECK(checkStore(store, model, inFlight));
+        inFlight.active = false;
+        runWrites<Flash>(store, model, inFlight, random, 1000);
+        // If the cut didn't come yet, it comes during a compaction, or the
+        // next boot is a plain reset
+        while(!Flash::isPowerOff() && isBusy(store)) {
+            store.task();
+            model.update(store);
+        }
+        Flash::restorePower();
+    }
+    return true;
+}
+
+/** Writes with the page full are held, without a flash operation, and reach
+ * the flash once the settings task has finished the compaction
+ */
+template<class Flash>
+bool testDeferredWrites() {
+    Flash::reset();
+    SettingsStore<Flash> store;
+    store.initialize();
+    Model model;
+    model.clear();
+    uint32_t pending = 0;
+    for(uint32_t i = 0; i < 2 * SettingsStore<Flash>::RecordsPerPage; i++) {
+        uint32_t key = i % NumKeys;
+        uint32_t before = Flash::getOperationCount();
+        CHECK(store.set((Key)key, i));
+        // A record is two double-word programs; a compaction would erase
+        CHECK(Flash::getOperationCount() - before <= 2);
+        model.accept(store, key, i);
+        if(store.isPending((Key)key)) {
+            pending++;
+        }
+        uint32_t v;
+        CHECK(store.get((Key)key, v) && v == i);
+    }
+    CHECK(pending > 0);
+    CHECK(store.isCompacting());
+    while(isBusy(store)) {
+        CHECK(store.task());
+        model.update(store);
+    }
+    SettingsStore<Flash> rebooted;
+    rebooted.initialize();
+    InFlight none = {false, 0, 0};
+    CHECK(checkStore(rebooted, model, none));
+    return true;
+}
+
+template<class Flash>
+bool testBackend(const char *name, bool eccErrors) {
+    Flash::setTornEccErrors(eccErrors);
+    if(!testDeferredWrites<Flash>()) {
+        printf("%s: failed\n", name);
+        return false;
+    }
+    uint32_t cutPoints = 0;
+    if(!testEveryCutPoint<Flash>(200, cutPoints)) {
+        printf("%s: failed\n", name);
+        return false;
+    }
+    const uint32_t boots = 5000;
+    if(!testRandomCuts<Flash>(1, boots)) {
+        printf("%s: failed\n", name);
+        return false;
+    }
+    printf("%s: %u cut points, %u random boots, page erases:", name, (unsigned)cutPoints, (unsigned)boots);
+    for(uint8_t page = 0; page < Flash::NumPages; page++) {
+        printf(" %u", (unsigned)Flash::getEraseCount(page));
+    }
+    if(eccErrors) {
+        printf(", ECC errors: %u", (unsigned)Flash::getEccRepairs());
+        // Torn double-words were read, not only erased over
+        CHECK(Flash::getEccRepairs() > 0);
+    }
+    printf("\n");
+    return true;
+}
+
+int main() {
+    // Small pages, so that the workloads go through many compactions. The
+    // firmware uses two pages.
+    bool ok = testBackend<EmulatedFlashBackend<512, 2>>("2 pages", false);
+    ok = testBackend<EmulatedFlashBackend<512, 3>>("3 pages", false) && ok;
+    ok = testBackend<EmulatedFlashBackend<512, 2>>("2 pages, torn ECC", true) && ok;
+    ok = testBackend<EmulatedFlashBackend<512, 3>>("3 pages, torn ECC", true) && ok;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,229 @@
+/** Tests for the speed supervisor
+ *
+ * Drives the supervisor the way the tach task does: a simulated rotor makes
+ * tach pulses, TachDetector measures them at 1 kHz, and every 10 ms the
+ * supervisor is updated with the setpoint and the measured speed, period and
+ * time since the last edge. Checks that each fault trips when it should, and
+ * that lowering the setpoint or stopping doesn't trip anything.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "check.hpp"
+#include "SpeedSupervisor.hpp"
+#include "TachDetector.hpp"
+
+using Fault = SpeedSupervisor::Fault;
+
+// As in main.cpp
+static const SpeedSupervisor::Config SupervisorConfig = {3, 30, 900, 10000, 11000, 500, 1000, 2000};
+static const uint32_t CheckPeriodMs = 10;
+
+/** Rotor, tach and supervisor, stepped one millisecond at a time */
+class Rig {
+public:
+    Rig() : supervisor(SupervisorConfig), ms(0), phase(0.0), rpm(0.0f), setpoint(0), pulses(true) {}
+
+    /** Run for `duration` ms with the rotor changing speed towards `target`
+     * at `rpmPerS`, or until a fault trips
+     *
+     * @return The fault
+     */
+    Fault run(uint32_t duration, float target, float rpmPerS) {
+        for(uint32_t i = 0; i < duration; i++) {
+            float step = rpmPerS / 1000.0f;
+            if(rpm < target) {
+                rpm = fminf(rpm + step, target);
+            } else {
+                rpm = fmaxf(rpm - step, target);
+            }
+            phase = fmod(phase + rpm / 60000.0, 1.0);
+            bool high = pulses && rpm > 0.0f && phase < 0.3;
+            detector.processSample(high ? 2400 : 1600);
+            ms++;
+            if(ms % CheckPeriodMs == 0) {
+                detector.update();
+                uint32_t measured = (uint32_t)(60 * detector.getFrequency());
+                Fault fault = supervisor.update(setpoint, measured, detector.getPeriodMs(),
+                    detector.getMsSinceLastEdge(), CheckPeriodMs);
+                if(fault != Fault::None) {
+                    return fault;
+                }
+            }
+        }
+        return Fault::None;
+    }
+
+    TachDetector<TachDetectorConfig> detector;
+    SpeedSupervisor supervisor;
+    uint32_t ms;
+    double phase;
+    float rpm;
+    uint32_t setpoint;
+    // False when the tach sees nothing, e.g. the sensor came loose
+    bool pulses;
+};
+
+/** At 3000 RPM the tach loss timeout is 3 periods, 60 ms, rather than the
+ * tach's own second
+ */
+bool testTachLoss() {
+    Rig rig;
+    rig.setpoint = 3000;
+    CHECK(rig.run(3000, 3000, 1000000) == Fault::None);
+    rig.pulses = false;
+    uint32_t lostAt = rig.ms;
+    CHECK(rig.run(2000, 3000, 0) == Fault::TachLoss);
+    uint32_t detection = rig.supervisor.getDetectionMs();
+    printf("tach loss at 3000 RPM: tripped %u ms after the last pulse, %u ms after the loss\n",
+        (unsigned)detection, (unsigned)(rig.ms - lostAt));
+    CHECK(detection > 60 && detection <= 60 + CheckPeriodMs);
+    CHECK(rig.supervisor.getFaultRpm() > 2900);
+    return true;
+}
+
+/** At 100 RPM three periods would be 1.8 s, so the 900 ms cap applies. The
+ * tach drops its periods at its own 1 s timeout, so this also checks that
+ * the supervisor keeps the last one.
+ */
+bool testTachLossSlow() {
+    static const uint32_t Caps[] = {900, 2000};
+    for(uint32_t cap : Caps) {
+        SpeedSupervisor::Config config = SupervisorConfig;
+        config.maxTachTimeoutMs = cap;
+        Rig rig;
+        rig.supervisor = SpeedSupervisor(config);
+        rig.setpoint = 100;
+        CHECK(rig.run(6000, 100, 1000000) == Fault::None);
+        rig.pulses = false;
+        CHECK(rig.run(5000, 100, 0) == Fault::TachLoss);
+        uint32_t detection = rig.supervisor.getDetectionMs();
+        printf("tach loss at 100 RPM, %u ms cap: tripped %u ms after the last pulse\n",
+            (unsigned)cap, (unsigned)detection);
+        uint32_t timeout = cap < 1800 ? cap : 1800;
+        CHECK(detection > timeout && detection <= timeout + CheckPeriodMs);
+    }
+    return true;
+}
+
+/** A rotor which never turns, or a tach which never sees it, trips the spin
+ * up timeout, as there is no period to arm the tach loss with
+ */
+bool testSpinUpTimeout() {
+    Rig rig;
+    rig.setpoint = 3000;
+    CHECK(rig.run(20000, 0, 0) == Fault::SpinUpTimeout);
+    CHECK(rig.supervisor.getDetectionMs() > SupervisorConfig.spinUpMs);
+    CHECK(rig.supervisor.getDetectionMs() <= SupervisorConfig.spinUpMs + CheckPeriodMs);
+    CHECK(rig.ms <= SupervisorConfig.spinUpMs + 2 * CheckPeriodMs);
+
+    // Stalling after spinning up: stuck below half the setpoint, with the
+    // tach still seeing the rotor turn slowly
+    Rig stalled;
+    stalled.setpoint = 3000;
+    CHECK(stalled.run(3000, 3000, 1000000) == Fault::None);
+    CHECK(stalled.run(20000, 600, 5000) == Fault::SpinUpTimeout);
+    CHECK(stalled.supervisor.getFaultRpm() < 1500);
+
+    // A slow spin up which gets to half the setpoint in time is fine
+    Rig slow;
+    slow.setpoint = 3000;
+    CHECK(slow.run(15000, 3000, 200) == Fault::None);
+    return true;
+}
+
+bool testOverspeed() {
+    // Over the absolute limit trips at once
+    Rig runaway;
+    runaway.setpoint = 10000;
+    CHECK(runaway.run(3000, 10000, 1000000) == Fault::None);
+    CHECK(runaway.run(3000, 12000, 1000000) == Fault::Overspeed);
+    CHECK(runaway.supervisor.getDetectionMs() == 0);
+    CHECK(runaway.supervisor.getFaultRpm() > 11000);
+
+    // Over the setpoint plus margin trips after the overspeed time
+    Rig over;
+    over.setpoint = 3000;
+    CHECK(over.run(3000, 3000, 1000000) == Fault::None);
+    CHECK(over.run(5000, 3700, 1000000) == Fault::Overspeed);
+    CHECK(over.supervisor.getDetectionMs() > SupervisorConfig.overspeedMs);
+    CHECK(over.supervisor.getDetectionMs() <= SupervisorConfig.overspeedMs + 2 * CheckPeriodMs);
+
+    // Within the margin never trips
+    Rig within;
+    within.setpoint = 3000;
+    CHECK(within.run(3000, 3000, 1000000) == Fault::None);
+    CHECK(within.run(10000, 3400, 1000000) == Fault::None);
+    return true;
+}
+
+/** Lowering the setpoint leaves the rotor above it while it slows down. As
+ * long as it slows at least as fast as the deceleration limit, nothing trips.
+ */
+bool testSetpointDecrease() {
+    Rig rig;
+    rig.setpoint = 8000;
+    CHECK(rig.run(5000, 8000, 1000000) == Fault::None);
+    rig.setpoint = 1000;
+    CHECK(rig.run(10000, 1000, SupervisorConfig.decelRpmPerS) == Fault::None);
+    CHECK(rig.rpm == 1000.0f);
+
+    // Slower than that, with the margin used up, it is an overspeed
+    rig.setpoint = 8000;
+    CHECK(rig.run(5000, 8000, 1000000) == Fault::None);
+    rig.setpoint = 1000;
+    CHECK(rig.run(10000, 1000, SupervisorConfig.decelRpmPerS / 2) == Fault::Overspeed);
+
+    // Stopping: the tach goes quiet as the rotor coasts down, and that isn't
+    // a tach loss
+    Rig stop;
+    stop.setpoint = 6000;
+    CHECK(stop.run(5000, 6000, 1000000) == Fault::None);
+    stop.setpoint = 0;
+    CHECK(stop.run(10000, 0, SupervisorConfig.decelRpmPerS) == Fault::None);
+    stop.pulses = false;
+    CHECK(stop.run(3000, 0, 0) == Fault::None);
+    return true;
+}
+
+/** The time since the last edge saturates instead of wrapping, so a tach
+ * lost for longer than the counter holds still reads as lost
+ */
+bool testSinceEdgeSaturates() {
+    Rig rig;
+    rig.setpoint = 3000;
+    CHECK(rig.run(3000, 3000, 1000000) == Fault::None);
+    rig.pulses = false;
+
+    // The count saturates after UINT32_MAX / 1000 samples, about 72 minutes,
+    // so that converting it to ms can't overflow
+    uint32_t last = 0;
+    uint32_t samples = UINT32_MAX / TachDetectorConfig::SamplePeriodUs + 1000;
+    for(uint32_t i = 0; i < samples; i++) {
+        rig.detector.processSample(1600);
+        uint32_t since = rig.detector.getMsSinceLastEdge();
+        CHECK(since >= last);
+        last = since;
+    }
+    printf("time since the last edge after %u samples without one: %u ms\n", (unsigned)samples, (unsigned)last);
+    CHECK(last == UINT32_MAX / TachDetectorConfig::SamplePeriodUs * TachDetectorConfig::SamplePeriodUs / 1000);
+    rig.detector.update();
+    CHECK(rig.detector.getFrequency() == 0.0f);
+    CHECK(rig.supervisor.update(3000, 0, rig.detector.getPeriodMs(), last, CheckPeriodMs) == Fault::TachLoss);
+    return true;
+}
+
+int main() {
+    bool ok = testTachLoss();
+    ok = testTachLossSlow() && ok;
+    ok = testSpinUpTimeout() && ok;
+    ok = testOverspeed() && ok;
+    ok = testSetpointDecrease() && ok;
+    ok = testSinceEdgeSaturates() && ok;
+    if(ok) {
+        printf("all faults trip as expected\n");
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
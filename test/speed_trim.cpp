@@ -0,0 +1,191 @@
+/** Tests for the STSPIN speed trim
+ *
+ * Drives SpeedTrim against a model of the open-loop controller, which ramps
+ * its electrical rate towards the command at 2000 RPM/s, with the rotor
+ * turning at a fixed fraction of it (slip, or a wrong pole pair count) and
+ * 0.5% of tach noise. Checks the steady speed error and the settling time
+ * against the numbers in the commit adding the trim, and the limits on how
+ * fast and how far the trim moves.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "check.hpp"
+#include "SpeedTrim.hpp"
+
+// As in main.cpp
+static const SpeedTrim::Config TrimConfig = {0.5f, 250, 20, 2000};
+static const uint32_t PeriodMs = 100;
+static const float RampRpmPerS = 2000.0f;
+static const float TachNoise = 0.005f;
+
+/** Small deterministic generator, so every run sees the same noise */
+class Lcg {
+public:
+    explicit Lcg(uint32_t seed) : state(seed) {}
+
+    float uniform() {
+        state = state * 1664525u + 1013904223u;
+        return ((state >> 8) + 0.5f) / 16777216.0f;
+    }
+
+    float gauss(float sigma) {
+        return sigma * sqrtf(-2.0f * logf(uniform())) * cosf(2.0f * (float)M_PI * uniform());
+    }
+
+private:
+    uint32_t state;
+};
+
+/** Open-loop controller and rotor */
+class Motor {
+public:
+    /** @param ratio Rotor speed over commanded speed */
+    explicit Motor(float _ratio) : ratio(_ratio), rate(0.0f), rng(3) {}
+
+    /** Take a command for one control period, and return the tach reading */
+    uint32_t step(uint32_t command) {
+        float maxStep = RampRpmPerS * PeriodMs / 1000.0f;
+        float d = command - rate;
+        rate += d > maxStep ? maxStep : (d < -maxStep ? -maxStep : d);
+        return (uint32_t)fmaxf(0.0f, getRpm() * (1.0f + rng.gauss(TachNoise)));
+    }
+
+    float getRpm() const {
+        return rate * ratio;
+    }
+
+private:
+    float ratio;
+    float rate;
+    Lcg rng;
+};
+
+struct Outcome {
+    // Mean relative error over the last 20 s of a 60 s run
+    float errorPct;
+    // Time after which the speed stayed within 1% of the setpoint, -1 if never
+    int32_t settleMs;
+};
+
+static Outcome run(SpeedTrim &trim, float ratio, uint32_t setpoint, bool trimmed) {
+    Motor motor(ratio);
+    uint32_t rpm = 0;
+    float errorSum = 0.0f;
+    uint32_t errors = 0;
+    Outcome o = {0.0f, -1};
+    for(uint32_t ms = 0; ms < 60000; ms += PeriodMs) {
+        uint32_t command = trimmed ? trim.update(setpoint, rpm, PeriodMs) : setpoint;
+        rpm = motor.step(command);
+        float error = (motor.getRpm() - setpoint) / setpoint;
+        if(fabsf(error) >= 0.01f) {
+            o.settleMs = -1;
+        } else if(o.settleMs < 0) {
+            o.settleMs = ms;
+        }
+        if(ms >= 40000) {
+            errorSum += error;
+            errors++;
+        }
+    }
+    o.errorPct = errorSum / errors * 100.0f;
+    return o;
+}
+
+struct ErrorSource {
+    const char *name;
+    float ratio;
+    // Settling time to check against
+    int32_t maxSettleMs;
+};
+
+static const ErrorSource Sources[] = {
+    {"3% slip", 0.97f, 5000},
+    {"6 vs 7 poles", 6.0f / 7.0f, 12000},
+    {"7 vs 6 poles", 7.0f / 6.0f, 12000},
+};
+
+static const uint32_t Setpoints[] = {500, 1500, 3000, 6000};
+
+bool testSteadyError() {
+    printf("%-14s %8s %10s %10s %8s\n", "", "setpoint", "open loop", "trimmed", "settled");
+    for(const ErrorSource &source : Sources) {
+        for(uint32_t setpoint : Setpoints) {
+            SpeedTrim open(TrimConfig);
+            SpeedTrim trim(TrimConfig);
+            Outcome o = run(open, source.ratio, setpoint, false);
+            Outcome t = run(trim, source.ratio, setpoint, true);
+            printf("%-14s %8u %9.2f%% %9.2f%% %6.1f s\n", source.name, (unsigned)setpoint,
+                o.errorPct, t.errorPct, t.settleMs / 1000.0f);
+            CHECK(fabsf(t.errorPct) < 0.1f);
+            CHECK(t.settleMs >= 0 && t.settleMs <= source.maxSettleMs);
+        }
+    }
+    return true;
+}
+
+/** The trim holds while the setpoint settles, then moves by at most the rate
+ * limit per period, and no further than the trim limit
+ */
+bool testLimits() {
+    SpeedTrim trim(TrimConfig);
+    // The rotor turns at half the command, more than the trim can make up
+    for(uint32_t ms = 0; ms < TrimConfig.settleMs; ms += PeriodMs) {
+        trim.update(3000, 1500, PeriodMs);
+        CHECK(trim.getTrim() == 0.0f);
+    }
+    float maxStep = TrimConfig.maxRatePermillePerS / 1000.0f * PeriodMs / 1000.0f;
+    float last = trim.getTrim();
+    for(uint32_t ms = 0; ms < 30000; ms += PeriodMs) {
+        trim.update(3000, 1500, PeriodMs);
+        CHECK(trim.getTrim() - last <= maxStep * 1.001f);
+        last = trim.getTrim();
+    }
+    CHECK(trim.getTrim() == TrimConfig.maxTrimPermille / 1000.0f);
+    CHECK(trim.update(3000, 1500, PeriodMs) == 3750);
+
+    // Without a tach reading it holds
+    trim.update(3000, 0, PeriodMs);
+    CHECK(trim.getTrim() == last);
+    return true;
+}
+
+/** Stopping keeps the trim, so the next run starts out trimmed, and a new
+ * setpoint is trimmed by the same factor at once
+ */
+bool testKeptBetweenRuns() {
+    SpeedTrim trim(TrimConfig);
+    Outcome first = run(trim, 0.97f, 3000, true);
+    CHECK(fabsf(first.errorPct) < 0.1f);
+    float factor = trim.getTrim();
+    CHECK(trim.update(0, 2900, PeriodMs) == 0);
+    CHECK(trim.getTrim() == factor);
+
+    Motor motor(0.97f);
+    uint32_t rpm = 0;
+    int32_t settleMs = -1;
+    for(uint32_t ms = 0; ms < 10000; ms += PeriodMs) {
+        rpm = motor.step(trim.update(5000, rpm, PeriodMs));
+        if(fabsf(motor.getRpm() / 5000.0f - 1.0f) >= 0.01f) {
+            settleMs = -1;
+        } else if(settleMs < 0) {
+            settleMs = ms;
+        }
+    }
+    printf("next run at 5000 RPM: within 1%% after %.1f s\n", settleMs / 1000.0f);
+    // Only the controller's ramp, 2.5 s to 5000 RPM
+    CHECK(settleMs >= 0 && settleMs <= 2600);
+    return true;
+}
+
+int main() {
+    bool ok = testSteadyError();
+    ok = testLimits() && ok;
+    ok = testKeptBetweenRuns() && ok;
+    if(ok) {
+        printf("trimmed to within 0.1%%\n");
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,112 @@
+/** Two-thread stress test for SpscRingBuffer
+ *
+ * A producer thread pushes a numbered sequence while the consumer thread pops
+ * it, one element at a time and in blocks, as the tach task does. Each element
+ * carries its number twice, so that an element read before it was completely
+ * written shows up. Run once with a producer which retries when the buffer is
+ * full, where nothing may be lost, and once with one which drops, as the ADC
+ * ISR does, where every lost element must be counted as an overrun.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+#include "check.hpp"
+#include "SpscRingBuffer.hpp"
+
+struct Element {
+    uint32_t sequence;
+    uint32_t inverse;
+};
+
+static const uint32_t Count = 1000000;
+
+// Small, so that the buffer runs full and empty all the time
+using Buffer = SpscRingBuffer<Element, 64>;
+
+bool run(bool lossy) {
+    Buffer buffer;
+    std::atomic<bool> producerDone(false);
+    uint32_t pushed = 0;
+
+    std::thread producer([&] {
+        for(uint32_t i = 0; i < Count; i++) {
+            Element e = {i, ~i};
+            if(lossy) {
+                pushed += buffer.push(e) ? 1 : 0;
+                // Give the consumer a chance now and then, as between
+                // interrupts, so that not everything is dropped
+                if(i % 48 == 0) {
+                    std::this_thread::yield();
+                }
+            } else {
+                while(!buffer.push(e)) {
+                    std::this_thread::yield();
+                }
+                pushed++;
+            }
+        }
+        producerDone.store(true, std::memory_order_release);
+    });
+
+    uint32_t received = 0;
+    bool ok = true;
+    std::thread consumer([&] {
+        uint32_t next = 0;
+        Element block[16];
+        uint32_t round = 0;
+        while(true) {
+            // Taken before the pop, so that once the producer is done and the
+            // buffer is found empty, nothing more can arrive
+            bool done = producerDone.load(std::memory_order_acquire);
+            uint32_t n;
+            // Alternate between single and block pops of varying size
+            if(round++ % 2 == 0) {
+                n = buffer.pop(block[0]) ? 1 : 0;
+            } else {
+                n = buffer.pop(std::span<Element>(block, round % 16 + 1));
+            }
+            for(uint32_t i = 0; i < n; i++) {
+                bool good = block[i].inverse == ~block[i].sequence &&
+                    (lossy ? block[i].sequence >= next : block[i].sequence == next);
+                if(!good) {
+                    printf("element %u out of order or torn after %u\n", (unsigned)block[i].sequence, (unsigned)next);
+                    ok = false;
+                    return;
+                }
+                next = block[i].sequence + 1;
+                received++;
+            }
+            if(n == 0) {
+                if(done) {
+                    return;
+                }
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    producer.join();
+    consumer.join();
+    CHECK(ok);
+    CHECK(received == pushed);
+    CHECK(buffer.empty());
+    if(lossy) {
+        CHECK(pushed + buffer.getOverruns() == Count);
+    } else {
+        // Full buffers still count as overruns, even though the producer
+        // tried again
+        CHECK(received == Count);
+    }
+    CHECK(buffer.getHighWater() <= Buffer::Capacity);
+    printf("%s: %u received, %u overruns, high water %u\n", lossy ? "dropping" : "retrying",
+        (unsigned)received, (unsigned)buffer.getOverruns(), (unsigned)buffer.getHighWater());
+    return true;
+}
+
+int main() {
+    bool ok = run(false);
+    ok = run(true) && ok;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,185 @@
+/** Tests for the step response test
+ *
+ * Runs StepTest against a second-order model of the spindle, sampled every
+ * 100 ms as the motor task does, with a little tach noise, and checks the
+ * rise time, overshoot and settling time of each step, up and down, against
+ * the same model's response worked out at 1 ms. Also checks the ripple
+ * measured with a known ripple added to the speed.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "check.hpp"
+#include "StepResponse.hpp"
+
+static const uint32_t SamplePeriodMs = 100;
+static const uint32_t HoldMs = 8000;
+static const uint16_t Speeds[] = {1000, 3000, 2000};
+static const uint8_t NumSteps = sizeof(Speeds) / sizeof(Speeds[0]);
+
+/** Small deterministic generator, so every run sees the same noise */
+class Lcg {
+public:
+    explicit Lcg(uint32_t seed) : state(seed) {}
+
+    float uniform() {
+        state = state * 1664525u + 1013904223u;
+        return ((state >> 8) + 0.5f) / 16777216.0f;
+    }
+
+private:
+    uint32_t state;
+};
+
+/** Speed following the setpoint with natural frequency `wn` and damping `zeta` */
+class Spindle {
+public:
+    Spindle(double _wn, double _zeta) : wn(_wn), zeta(_zeta), rpm(0.0), rate(0.0) {}
+
+    /** Advance by 1 ms */
+    void step(double setpoint) {
+        double accel = wn * wn * (setpoint - rpm) - 2.0 * zeta * wn * rate;
+        rate += accel * 1e-3;
+        rpm += rate * 1e-3;
+    }
+
+    double getRpm() const {
+        return rpm;
+    }
+
+private:
+    double wn;
+    double zeta;
+    double rpm;
+    double rate;
+};
+
+/** The model's unit step response, at 1 ms */
+struct Reference {
+    double riseMs;
+    double overshootPct;
+    double settleMs;
+};
+
+static Reference reference(double wn, double zeta) {
+    Spindle spindle(wn, zeta);
+    Reference r = {0.0, 0.0, 0.0};
+    double rise10 = -1.0;
+    double rise90 = -1.0;
+    for(uint32_t ms = 1; ms <= HoldMs; ms++) {
+        spindle.step(1.0);
+        double x = spindle.getRpm();
+        if(rise10 < 0.0 && x >= 0.1) {
+            rise10 = ms;
+        }
+        if(rise90 < 0.0 && x >= 0.9) {
+            rise90 = ms;
+        }
+        r.overshootPct = fmax(r.overshootPct, (x - 1.0) * 100.0);
+        if(fabs(x - 1.0) > StepResponse::SettleBandPct / 100.0) {
+            r.settleMs = ms;
+        }
+    }
+    r.riseMs = rise90 - rise10;
+    return r;
+}
+
+/** Run the whole test, with `noise` counts of tach noise and a sine ripple of
+ * `rippleRpm` amplitude
+ */
+static void run(StepTest<4> &test, double wn, double zeta, float noise, float rippleRpm) {
+    Spindle spindle(wn, zeta);
+    Lcg rng(5);
+    uint32_t ms = 0;
+    uint32_t rpm = 0;
+    test.start(Speeds, NumSteps, SamplePeriodMs, HoldMs);
+    while(test.isRunning()) {
+        uint16_t setpoint = test.update(rpm);
+        for(uint32_t i = 0; i < SamplePeriodMs; i++) {
+            spindle.step(setpoint);
+            ms++;
+        }
+        float ripple = rippleRpm * sinf(2.0f * (float)M_PI * 1.3f * ms / 1000.0f);
+        rpm = (uint32_t)fmax(0.0, spindle.getRpm() + ripple + noise * (2.0f * rng.uniform() - 1.0f));
+    }
+}
+
+static bool checkSteps(double wn, double zeta) {
+    Reference ref = reference(wn, zeta);
+    StepTest<4> test;
+    run(test, wn, zeta, 10.0f, 0.0f);
+    CHECK(test.isComplete());
+    CHECK(test.getNumSteps() == NumSteps);
+    CHECK(test.update(3000) == 0);
+    printf("wn %.1f rad/s, zeta %.1f: rise %.0f ms, overshoot %.1f%%, settled in %.0f ms\n",
+        wn, zeta, ref.riseMs, ref.overshootPct, ref.settleMs);
+    for(uint8_t i = 0; i < NumSteps; i++) {
+        const StepResponse::Result &r = test.getResult(i);
+        printf("  to %4u RPM: rise %u ms, overshoot %u%%, settled in %u ms, ripple %u RPM\n",
+            (unsigned)r.targetRpm, (unsigned)r.riseMs, (unsigned)r.overshootPct, (unsigned)r.settleMs,
+            (unsigned)r.rippleRpm);
+        CHECK(r.targetRpm == Speeds[i]);
+        // Both ends of the rise are late by up to a sample, and the settling
+        // time by up to one, plus a little for the noise
+        CHECK(fabs(r.riseMs - ref.riseMs) <= SamplePeriodMs + 10);
+        CHECK(r.settleMs >= ref.settleMs - 10 && r.settleMs <= ref.settleMs + SamplePeriodMs + 10);
+        // Overshoot is truncated to whole percent, and the sampled peak can
+        // be a little below the true one. The noise is 1% of the smallest
+        // step, so it can add that much.
+        CHECK(r.overshootPct <= ref.overshootPct + 1 && r.overshootPct + 2 >= ref.overshootPct);
+        CHECK(r.rippleRpm <= 20);
+    }
+    return true;
+}
+
+/** A critically damped spindle with wn 3 rad/s rises in 3.358 / wn, 1.12 s */
+bool testCriticallyDamped() {
+    Reference ref = reference(3.0, 1.0);
+    CHECK(fabs(ref.riseMs - 3358.0 / 3.0) <= 2.0);
+    CHECK(ref.overshootPct < 0.01);
+    return checkSteps(3.0, 1.0);
+}
+
+/** At zeta 0.4 the overshoot is exp(-pi zeta / sqrt(1 - zeta^2)), 25.4% */
+bool testUnderdamped() {
+    Reference ref = reference(3.0, 0.4);
+    CHECK(fabs(ref.overshootPct - 100.0 * exp(-M_PI * 0.4 / sqrt(1.0 - 0.4 * 0.4))) < 0.1);
+    return checkSteps(3.0, 0.4);
+}
+
+/** A 50 RPM ripple shows as 100 RPM peak to peak, plus at most the noise */
+bool testRipple() {
+    StepTest<4> test;
+    run(test, 3.0, 1.0, 10.0f, 50.0f);
+    CHECK(test.isComplete());
+    for(uint8_t i = 0; i < NumSteps; i++) {
+        uint32_t ripple = test.getResult(i).rippleRpm;
+        CHECK(ripple >= 95 && ripple <= 120);
+    }
+    return true;
+}
+
+/** Aborting stops the test with no results, and the setpoint goes to 0 */
+bool testAbort() {
+    StepTest<4> test;
+    test.start(Speeds, NumSteps, SamplePeriodMs, HoldMs);
+    CHECK(test.update(0) == Speeds[0]);
+    test.abort();
+    CHECK(!test.isRunning());
+    CHECK(!test.isComplete());
+    CHECK(test.update(1000) == 0);
+    return true;
+}
+
+int main() {
+    bool ok = testCriticallyDamped();
+    ok = testUnderdamped() && ok;
+    ok = testRipple() && ok;
+    ok = testAbort() && ok;
+    if(ok) {
+        printf("step responses match the model\n");
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
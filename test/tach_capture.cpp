@@ -0,0 +1,198 @@
+/** Tests for the tach sample capture packets
+ *
+ * Sends samples through TachCapture into a fake UART, decodes the packets the
+ * way tools/capture.py does, and checks that the samples come back unchanged
+ * and that sample buffer overruns show as gaps at the sample they happened
+ * before, also when they happen partway through a packet.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "check.hpp"
+#include "TachCapture.hpp"
+
+static const uint32_t BlockSize = 32;
+
+struct FakeUart {
+    static std::vector<uint8_t> written;
+
+    static std::size_t transmitBufferSize() {
+        return 0;
+    }
+
+    static void write(const uint8_t *data, std::size_t length) {
+        written.insert(written.end(), data, data + length);
+    }
+};
+
+std::vector<uint8_t> FakeUart::written;
+
+using Capture = TachCapture<FakeUart, 512, BlockSize>;
+
+/** A run of samples, and how many were lost just before it */
+struct Segment {
+    uint32_t start;
+    uint32_t lost;
+    std::vector<uint16_t> samples;
+};
+
+/** Decode the packets written so far into segments split at the gaps, as
+ * read_segments() in capture.py sees them
+ */
+static bool decode(std::vector<Segment> &segments) {
+    const std::vector<uint8_t> &data = FakeUart::written;
+    bool first = true;
+    uint8_t sequence = 0;
+    uint16_t overruns = 0;
+    uint32_t start = 0;
+    segments.clear();
+    for(std::size_t i = 0; i < data.size();) {
+        CHECK(data[i] == Capture::Sync);
+        std::size_t length = Capture::HeaderSize + data[i + 2];
+        CHECK(i + length + 2 <= data.size());
+        const uint8_t *packet = &data[i];
+        uint8_t sum = 0;
+        uint8_t sumOfSums = 0;
+        for(std::size_t j = 0; j < length; j++) {
+            sum += packet[j];
+            sumOfSums += sum;
+        }
+        CHECK(packet[length] == sum && packet[length + 1] == sumOfSums);
+
+        uint32_t lost = 0;
+        uint16_t packetOverruns = packet[3] | (packet[4] << 8);
+        if(!first) {
+            lost += (uint8_t)(packet[1] - sequence - 1) * BlockSize;
+            lost += (uint16_t)(packetOverruns - overruns);
+        }
+        sequence = packet[1];
+        overruns = packetOverruns;
+        if(first || lost > 0) {
+            if(!first) {
+                start += segments.back().samples.size();
+            }
+            segments.push_back({start, lost, {}});
+        }
+        first = false;
+
+        uint16_t sample = packet[5] | (packet[6] << 8);
+        segments.back().samples.push_back(sample);
+        for(std::size_t j = Capture::HeaderSize; j < length;) {
+            if(packet[j] == Capture::Escape) {
+                sample = packet[j + 1] | (packet[j + 2] << 8);
+                j += 3;
+            } else {
+                sample += (int8_t)packet[j];
+                j++;
+            }
+            segments.back().samples.push_back(sample);
+        }
+        i += length + 2;
+    }
+    return true;
+}
+
+static uint16_t sampleAt(uint32_t i) {
+    // Mostly small steps, with a jump that needs the escape now and then
+    return 2048 + (i % 50) * 20 - (i % 7 == 0 ? 700 : 0);
+}
+
+/** Push `count` samples from `first` on, in blocks of `blockSize` */
+static void pushRange(Capture &capture, uint32_t first, uint32_t count, uint32_t blockSize, uint32_t overruns) {
+    uint16_t block[BlockSize];
+    for(uint32_t i = 0; i < count; i += blockSize) {
+        uint32_t n = count - i < blockSize ? count - i : blockSize;
+        for(uint32_t j = 0; j < n; j++) {
+            block[j] = sampleAt(first + i + j);
+        }
+        capture.push(block, n, overruns);
+    }
+}
+
+static bool checkSamples(const Segment &segment, uint32_t first) {
+    for(uint32_t i = 0; i < segment.samples.size(); i++) {
+        CHECK(segment.samples[i] == sampleAt(first + i));
+    }
+    return true;
+}
+
+bool testRoundTrip() {
+    FakeUart::written.clear();
+    Capture capture;
+    capture.start();
+    pushRange(capture, 0, 100, 7, 0);
+    capture.stop();
+
+    std::vector<Segment> segments;
+    CHECK(decode(segments));
+    CHECK(segments.size() == 1);
+    CHECK(segments[0].samples.size() == 100);
+    CHECK(checkSamples(segments[0], 0));
+    CHECK(capture.getSent() == 4);
+    CHECK(capture.getDropped() == 0);
+    return true;
+}
+
+/** An overrun partway through a packet must split it where it happened, not
+ * at the start of the next packet
+ */
+bool testGapMidPacket() {
+    FakeUart::written.clear();
+    Capture capture;
+    capture.start();
+    // 40 samples: one full packet, and 8 into the next
+    pushRange(capture, 0, 40, 8, 3);
+    // 5 samples lost, then the rest
+    pushRange(capture, 45, 60, 8, 8);
+    capture.stop();
+
+    std::vector<Segment> segments;
+    CHECK(decode(segments));
+    CHECK(segments.size() == 2);
+    CHECK(segments[0].start == 0);
+    CHECK(segments[0].samples.size() == 40);
+    CHECK(checkSamples(segments[0], 0));
+    CHECK(segments[1].start == 40);
+    CHECK(segments[1].lost == 5);
+    CHECK(segments[1].samples.size() == 60);
+    CHECK(checkSamples(segments[1], 45));
+    return true;
+}
+
+/** Overruns at the start of a push which also fills a packet, and two in a
+ * row
+ */
+bool testGapsAtBlockBoundaries() {
+    FakeUart::written.clear();
+    Capture capture;
+    capture.start();
+    pushRange(capture, 0, 32, 32, 0);
+    pushRange(capture, 33, 32, 32, 1);
+    pushRange(capture, 65, 3, 3, 1);
+    pushRange(capture, 70, 4, 4, 3);
+    capture.stop();
+
+    std::vector<Segment> segments;
+    CHECK(decode(segments));
+    CHECK(segments.size() == 3);
+    CHECK(segments[0].samples.size() == 32);
+    CHECK(segments[1].start == 32 && segments[1].lost == 1);
+    CHECK(segments[1].samples.size() == 35);
+    CHECK(checkSamples(segments[1], 33));
+    CHECK(segments[2].start == 67 && segments[2].lost == 2);
+    CHECK(segments[2].samples.size() == 4);
+    CHECK(checkSamples(segments[2], 70));
+    return true;
+}
+
+int main() {
+    bool ok = testRoundTrip();
+    ok = testGapMidPacket() && ok;
+    ok = testGapsAtBlockBoundaries() && ok;
+    if(ok) {
+        printf("all samples and gaps where they were pushed\n");
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
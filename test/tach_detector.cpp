@@ -0,0 +1,302 @@
+/** Comparison of the tach edge detector with the one it replaced
+ *
+ * Runs synthetic tach waveforms through TachDetector and through a copy of
+ * the detector before the envelope decay was fixed, and prints for each the
+ * time to the first valid RPM and the edges missed and detected extra
+ * against the pulses generated. The current detector must find every pulse
+ * once it has settled, also after the signal shrinks, and never detect one
+ * which isn't there.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "check.hpp"
+#include "TachDetector.hpp"
+
+using Detector = TachDetector<TachDetectorConfig>;
+using Config = TachDetectorConfig;
+
+/** The envelope detector as it was, with 4 fraction bits, so that the slow
+ * decay stopped 256 counts short of the signal, and without the return to
+ * acquiring after the signal collapses
+ */
+class OldDetector {
+public:
+    static const uint32_t SampleScale = 16;
+
+    /** True if there is a rising edge at this sample */
+    bool processSample(uint16_t rawSample) {
+        uint32_t sample = rawSample * SampleScale;
+        uint32_t decayShift = acquiring ? Config::AcquireDecayShift : Config::DecayShift;
+        if(sample > envelopeMax) {
+            envelopeMax += (sample - envelopeMax) >> Config::AttackShift;
+        } else {
+            envelopeMax -= (envelopeMax - sample) >> decayShift;
+        }
+        if(sample < envelopeMin) {
+            envelopeMin -= (envelopeMin - sample) >> Config::AttackShift;
+        } else {
+            envelopeMin += (sample - envelopeMin) >> decayShift;
+        }
+        if(++samplesSinceLastEdge == Config::TimeoutMs + 1) {
+            acquiring = true;
+            edgeCount = 0;
+        }
+        if(envelopeMax < envelopeMin + Config::MinSwing * SampleScale) {
+            return false;
+        }
+        uint32_t swing = envelopeMax - envelopeMin;
+        uint32_t high = envelopeMin + ((swing * Config::HighThreshold) >> 8);
+        uint32_t low = envelopeMin + ((swing * Config::LowThreshold) >> 8);
+        if(!lastState && sample > high) {
+            lastState = true;
+            if(edgeCount > 0) {
+                validPeriod = true;
+            }
+            samplesSinceLastEdge = 0;
+            if(edgeCount < Config::AcquireEdges) {
+                edgeCount++;
+            } else {
+                acquiring = false;
+            }
+            return true;
+        } else if(lastState && sample < low) {
+            lastState = false;
+        }
+        return false;
+    }
+
+    bool hasPeriod() const {
+        return validPeriod;
+    }
+
+private:
+    uint32_t samplesSinceLastEdge = 0;
+    uint32_t envelopeMax = 0;
+    uint32_t envelopeMin = 4095 * SampleScale;
+    bool acquiring = true;
+    uint32_t edgeCount = 0;
+    bool lastState = false;
+    bool validPeriod = false;
+};
+
+/** Small deterministic generator, so every run sees the same noise */
+class Lcg {
+public:
+    explicit Lcg(uint32_t seed) : state(seed) {}
+
+    float uniform() {
+        state = state * 1664525u + 1013904223u;
+        return ((state >> 8) + 0.5f) / 16777216.0f;
+    }
+
+    float gauss(float sigma) {
+        return sigma * sqrtf(-2.0f * logf(uniform())) * cosf(2.0f * (float)M_PI * uniform());
+    }
+
+private:
+    uint32_t state;
+};
+
+/** Pulse train with 30% duty, an amplitude which may change over time, and
+ * noise. `amplitude(i)` is the half swing at sample i.
+ */
+struct Waveform {
+    const char *name;
+    float period;
+    uint32_t length;
+    float noise;
+    float (*amplitude)(uint32_t i);
+    // Added to the sample, e.g. spikes
+    float (*extra)(uint32_t i);
+    // Pulses before this sample aren't counted, e.g. while the detector
+    // settles on a new signal
+    uint32_t countFrom;
+};
+
+struct Outcome {
+    int32_t firstValidMs;
+    uint32_t pulses;
+    uint32_t missed;
+    uint32_t extra;
+};
+
+static void generate(const Waveform &w, std::vector<uint16_t> &samples, std::vector<float> &edges) {
+    Lcg rng(1234);
+    samples.clear();
+    edges.clear();
+    for(uint32_t i = 0; i < w.length; i++) {
+        float phase = fmodf(i / w.period, 1.0f);
+        float a = w.amplitude(i);
+        float v = 2048.0f + (phase < 0.3f ? a : -a) + rng.gauss(w.noise);
+        if(w.extra) {
+            v += w.extra(i);
+        }
+        samples.push_back((uint16_t)fminf(fmaxf(v, 0.0f), 4095.0f));
+    }
+    for(float t = 0.0f; t < w.length; t += w.period) {
+        if(w.amplitude((uint32_t)t) > 0.0f) {
+            edges.push_back(t);
+        }
+    }
+}
+
+/** Match detected edges to generated ones. A detection counts for the pulse
+ * whose rising edge came up to half a period before it.
+ */
+static Outcome score(const Waveform &w, const std::vector<float> &edges, const std::vector<uint32_t> &detected,
+        int32_t firstValidMs) {
+    Outcome o = {firstValidMs, 0, 0, 0};
+    std::vector<bool> found(edges.size(), false);
+    for(uint32_t d : detected) {
+        bool matched = false;
+        for(uint32_t k = 0; k < edges.size(); k++) {
+            if(!found[k] && d + 0.5f >= edges[k] && d < edges[k] + w.period / 2) {
+                found[k] = true;
+                matched = true;
+                break;
+            }
+        }
+        if(!matched && d >= w.countFrom) {
+            o.extra++;
+        }
+    }
+    for(uint32_t k = 0; k < edges.size(); k++) {
+        if(edges[k] >= w.countFrom && edges[k] + w.period / 2 < w.length) {
+            o.pulses++;
+            if(!found[k]) {
+                o.missed++;
+            }
+        }
+    }
+    return o;
+}
+
+static Outcome runNew(const Waveform &w) {
+    std::vector<uint16_t> samples;
+    std::vector<float> edges;
+    generate(w, samples, edges);
+    Detector detector;
+    std::vector<uint32_t> detected;
+    int32_t firstValidMs = -1;
+    for(uint32_t i = 0; i < samples.size(); i++) {
+        detector.processSample(samples[i]);
+        detector.update();
+        if(detector.getMsSinceLastEdge() == 0) {
+            detected.push_back(i);
+        }
+        if(firstValidMs < 0 && detector.getPeriodMs() > 0) {
+            firstValidMs = i * Config::SamplePeriodUs / 1000;
+        }
+    }
+    return score(w, edges, detected, firstValidMs);
+}
+
+static Outcome runOld(const Waveform &w) {
+    std::vector<uint16_t> samples;
+    std::vector<float> edges;
+    generate(w, samples, edges);
+    OldDetector detector;
+    std::vector<uint32_t> detected;
+    int32_t firstValidMs = -1;
+    for(uint32_t i = 0; i < samples.size(); i++) {
+        if(detector.processSample(samples[i])) {
+            detected.push_back(i);
+        }
+        if(firstValidMs < 0 && detector.hasPeriod()) {
+            firstValidMs = i * Config::SamplePeriodUs / 1000;
+        }
+    }
+    return score(w, edges, detected, firstValidMs);
+}
+
+static float steady400(uint32_t) {
+    return 400.0f;
+}
+
+static float steady150(uint32_t) {
+    return 150.0f;
+}
+
+static float steady40(uint32_t) {
+    return 40.0f;
+}
+
+// Reflectivity drops after 3 s
+static float drop800to60(uint32_t i) {
+    return i < 3000 ? 800.0f : 60.0f;
+}
+
+// Reflectivity fades over 10 s
+static float fade300to60(uint32_t i) {
+    return i < 10000 ? 300.0f - 240.0f * i / 10000 : 60.0f;
+}
+
+// The signal goes away after 3 s, e.g. the tape came off
+static float gone(uint32_t i) {
+    return i < 3000 ? 400.0f : 0.0f;
+}
+
+// A few samples of interference at 3 s
+static float spike300(uint32_t i) {
+    if(i >= 3000 && i < 3003) {
+        return 300.0f;
+    }
+    if(i >= 3003 && i < 3006) {
+        return -300.0f;
+    }
+    return 0.0f;
+}
+
+static const Waveform Waveforms[] = {
+    // 3000 RPM, clean
+    {"clean 3000 rpm", 20.37f, 5000, 8.0f, steady400, nullptr, 0},
+    // Close to the highest speed
+    {"clean 5900 rpm", 10.17f, 5000, 8.0f, steady400, nullptr, 0},
+    // Slow, so the envelope decays for long between pulses
+    {"clean 250 rpm", 240.3f, 20000, 8.0f, steady400, nullptr, 0},
+    {"noisy 3000 rpm", 20.37f, 5000, 25.0f, steady150, nullptr, 0},
+    {"drop 800 to 60", 20.37f, 8000, 5.0f, drop800to60, nullptr, 3000},
+    {"spike on 40", 20.37f, 8000, 4.0f, steady40, spike300, 3000},
+    {"fade 300 to 60", 20.37f, 15000, 4.0f, fade300to60, nullptr, 1000},
+    {"signal gone", 20.37f, 8000, 8.0f, gone, nullptr, 3000},
+};
+
+// Pulses the detector may miss while it settles on a signal which has just
+// shrunk: an edge is overdue after 1.5 periods, and the collapse shows over
+// the next period
+static const uint32_t SettleMissed = 3;
+
+bool testWaveforms() {
+    printf("%-16s %22s %22s\n", "", "first valid ms", "missed/extra of pulses");
+    for(const Waveform &w : Waveforms) {
+        Outcome o = runOld(w);
+        Outcome n = runNew(w);
+        printf("%-16s %10d -> %-10d %4u/%u -> %u/%u of %u\n", w.name,
+            (int)o.firstValidMs, (int)n.firstValidMs,
+            (unsigned)o.missed, (unsigned)o.extra, (unsigned)n.missed, (unsigned)n.extra, (unsigned)n.pulses);
+        CHECK(n.firstValidMs >= 0);
+        CHECK(n.extra == 0);
+        CHECK(n.missed <= o.missed);
+        if(w.countFrom == 0) {
+            // From a clean start, only the acquisition's first pulses, which
+            // come before the envelope has any swing, may be missed
+            CHECK(n.missed <= 2);
+            CHECK(n.firstValidMs <= o.firstValidMs + (int32_t)w.period);
+        } else {
+            CHECK(n.missed <= SettleMissed);
+        }
+    }
+    return true;
+}
+
+int main() {
+    bool ok = testWaveforms();
+    if(ok) {
+        printf("no pulses missed or added once settled\n");
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
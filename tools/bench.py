@@ -0,0 +1,141 @@
+"""Collect benchmark results from a RUN_BENCHMARKS firmware and check them
+against a stored baseline.
+
+The firmware prints one JSON document on the ST-Link virtual COM port at boot.
+Results are read from the serial port (requires pyserial), or from a file
+with --input.
+
+Exits with status 1 if the mean cycle count of any case exceeds its baseline
+by more than the threshold, or if a case in the baseline is missing from the
+results. Use --save to store the current results as the
+new baseline.
+
+UI frames ("frame:..." entries) are checked differently: a frame fails if it
+sends more bytes to the display than in the baseline, or if the hash of the
+screen after it changed, i.e. the screen no longer shows exactly what it did
+in the baseline. The hash covers the whole screen, row by row, so drawing the
+same pixels in other bands doesn't change it. After an intended change to
+what is drawn, check the screen on the device and save a new baseline.
+
+RAM entries ("ram:..." entries) hold the size of an object, e.g. a UI page,
+and fail if it grew.
+"""
+
+import argparse
+import json
+import os
+import sys
+
+DEFAULT_BASELINE = os.path.join(os.path.dirname(__file__), "..", "bench", "baseline.json")
+
+
+def read_serial(port, baud, timeout):
+    import serial
+
+    lines = []
+    with serial.Serial(port, baud, timeout=timeout) as ser:
+        started = False
+        while True:
+            line = ser.readline().decode("ascii", errors="replace")
+            if not line:
+                raise RuntimeError("Timed out waiting for benchmark output")
+            if line.startswith("{\"benchmarks\""):
+                started = True
+            if started:
+                lines.append(line)
+                if line.strip() == "]}":
+                    break
+    return json.loads("".join(lines))
+
+
+def compare_frame(case, ref):
+    """Check a UI frame against its baseline; returns (ok, description)"""
+    change = case["bytes"] - ref["bytes"]
+    description = f"{case['bytes']} bytes in {case['draw_calls']} calls (baseline {ref['bytes']}, {change:+d})"
+    if case["hash"] != ref["hash"]:
+        return False, description + ", screen changed"
+    return change <= 0, description
+
+
+def compare(results, baseline, threshold):
+    base = {case["name"]: case for case in baseline["benchmarks"]}
+    failed = False
+    for case in results["benchmarks"]:
+        name = case["name"]
+        if name not in base:
+            if name.startswith("ram:"):
+                print(f"  NEW   {name}: {case['bytes']} bytes")
+            elif "hash" in case:
+                print(f"  NEW   {name}: {case['bytes']} bytes in {case['draw_calls']} calls")
+            else:
+                print(f"  NEW   {name}: mean {case['mean']}")
+            continue
+        if name.startswith("ram:"):
+            ref = base[name]["bytes"]
+            ok = case["bytes"] <= ref
+            failed = failed or not ok
+            print(f"  {'OK' if ok else 'FAIL':5} {name}: {case['bytes']} bytes (baseline {ref}, {case['bytes'] - ref:+d})")
+            continue
+        if "hash" in case:
+            ok, description = compare_frame(case, base[name])
+            failed = failed or not ok
+            print(f"  {'OK' if ok else 'FAIL':5} {name}: {description}")
+            continue
+        ref = base[name]["mean"]
+        change = (case["mean"] - ref) / ref if ref > 0 else 0.0
+        status = "OK"
+        if change > threshold:
+            status = "FAIL"
+            failed = True
+        print(f"  {status:5} {name}: mean {case['mean']} (baseline {ref}, {change:+.1%})")
+    # A case which didn't report, e.g. because the run crashed or was cut
+    # short, fails rather than being skipped
+    reported = {case["name"] for case in results["benchmarks"]}
+    for name in base:
+        if name not in reported:
+            print(f"  FAIL  {name}: missing from the results")
+            failed = True
+    return not failed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", default="/dev/ttyACM0", help="Serial port of the ST-Link VCP")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--timeout", type=float, default=30.0, help="Seconds to wait for output")
+    parser.add_argument("--input", help="Read results from this file instead of the serial port")
+    parser.add_argument("--output", help="Also write the results to this file")
+    parser.add_argument("--baseline", default=DEFAULT_BASELINE)
+    parser.add_argument("--threshold", type=float, default=0.10, help="Allowed relative regression of the mean")
+    parser.add_argument("--save", action="store_true", help="Store the results as the new baseline")
+    args = parser.parse_args()
+
+    if args.input:
+        with open(args.input) as f:
+            results = json.load(f)
+    else:
+        results = read_serial(args.port, args.baud, args.timeout)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent=2)
+
+    if args.save:
+        os.makedirs(os.path.dirname(args.baseline), exist_ok=True)
+        with open(args.baseline, "w") as f:
+            json.dump(results, f, indent=2)
+        print(f"Saved baseline to {args.baseline}")
+        return 0
+
+    if not os.path.exists(args.baseline):
+        print(f"No baseline at {args.baseline}; run with --save first", file=sys.stderr)
+        return 1
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+
+    return 0 if compare(results, baseline, args.threshold) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,266 @@
+"""Record raw tach signals from the spin coater, and replay them into it.
+
+record: starts a capture on the ST-Link virtual COM port, decodes the sample
+packets (see src/TachCapture.hpp) and writes the samples to a text file, one
+per line, until interrupted. Lost samples are written as "# gap <n>" comment
+lines, with n = -1 if the count isn't known. Lost packets, bad checksums and
+tach overruns are counted and printed at the end.
+
+replay: stops the ADC on the device, feeds the samples from a file through
+the tach edge detector at the real sample rate, and writes the RPM it
+measured, every 100 ms, to stdout as CSV. This way detector changes can be
+checked against signals recorded on the machine. The motor can't be started
+while replaying. The samples on either side of a gap don't follow on, so
+each run of samples between gaps is replayed on its own: the detector starts
+over after a gap, as after a signal loss, and the gap is reported on stderr.
+
+Requires pyserial.
+
+Examples:
+    capture.py record tape_a.txt
+    capture.py replay tape_a.txt > tape_a_rpm.csv
+"""
+
+import argparse
+import sys
+
+SYNC = 0xA5
+ESCAPE = 0x80
+HEADER_SIZE = 7
+BLOCK_SIZE = 32
+SAMPLES_PER_LINE = 10
+
+
+class Decoder:
+    """Splits the byte stream into text lines and sample packets"""
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.sequence = None
+        self.overruns = None
+        self.lost_packets = 0
+        self.bad_packets = 0
+        self.lost_samples = 0
+
+    def feed(self, data):
+        """Add received bytes, and return a list of ("text", line) and
+        ("samples", list) and ("gap", n) items
+        """
+        self.buf += data
+        items = []
+        while self.buf:
+            if self.buf[0] != SYNC:
+                end = self.buf.find(b"\n")
+                sync = self.buf.find(bytes([SYNC]))
+                if sync != -1 and (end == -1 or sync < end):
+                    # Text cut short by a packet, e.g. a reply dropped in part
+                    del self.buf[:sync]
+                    continue
+                if end == -1:
+                    break
+                items.append(("text", self.buf[:end].decode("ascii", errors="replace").strip()))
+                del self.buf[:end + 1]
+                continue
+
+            if len(self.buf) < HEADER_SIZE:
+                break
+            length = HEADER_SIZE + self.buf[2] + 2
+            if len(self.buf) < length:
+                break
+            packet = self.buf[:length]
+            if not self.check(packet):
+                # Not a packet after all, or corrupted; look for the next sync
+                self.bad_packets += 1
+                del self.buf[:1]
+                continue
+            del self.buf[:length]
+            items.extend(self.decode(packet))
+        return items
+
+    @staticmethod
+    def check(packet):
+        s = 0
+        ss = 0
+        for b in packet[:-2]:
+            s = (s + b) & 0xFF
+            ss = (ss + s) & 0xFF
+        return packet[-2] == s and packet[-1] == ss
+
+    def decode(self, packet):
+        items = []
+        sequence = packet[1]
+        overruns = packet[3] | (packet[4] << 8)
+        if self.sequence is not None:
+            missing = (sequence - self.sequence - 1) & 0xFF
+            if missing:
+                self.lost_packets += missing
+                self.lost_samples += missing * BLOCK_SIZE
+                items.append(("gap", missing * BLOCK_SIZE))
+        if self.overruns is not None:
+            dropped = (overruns - self.overruns) & 0xFFFF
+            if dropped:
+                self.lost_samples += dropped
+                items.append(("gap", dropped))
+        self.sequence = sequence
+        self.overruns = overruns
+
+        sample = packet[5] | (packet[6] << 8)
+        samples = [sample]
+        i = HEADER_SIZE
+        end = len(packet) - 2
+        while i < end:
+            if packet[i] == ESCAPE:
+                sample = packet[i + 1] | (packet[i + 2] << 8)
+                i += 3
+            else:
+                delta = packet[i] - 256 if packet[i] > 127 else packet[i]
+                sample += delta
+                i += 1
+            samples.append(sample)
+        items.append(("samples", samples))
+        return items
+
+
+def command(ser, line, decoder):
+    """Send a command, and return its reply, ignoring anything else"""
+    ser.write((line + "\n").encode("ascii"))
+    while True:
+        data = ser.read(max(1, ser.in_waiting))
+        if not data:
+            raise RuntimeError("Timed out waiting for a reply to " + line)
+        for kind, value in decoder.feed(data):
+            if kind == "text" and not value.startswith("T "):
+                return value
+
+
+def record(ser, path):
+    decoder = Decoder()
+    count = 0
+    with open(path, "w") as out:
+        out.write("# tach samples, 1 kHz\n")
+        reply = command(ser, "CAPTURE ON", decoder)
+        if reply != "OK":
+            raise RuntimeError("CAPTURE ON: " + reply)
+        try:
+            while True:
+                data = ser.read(max(1, ser.in_waiting))
+                for kind, value in decoder.feed(data):
+                    if kind == "samples":
+                        out.write("".join("%d\n" % v for v in value))
+                        count += len(value)
+                    elif kind == "gap":
+                        out.write("# gap %d\n" % value)
+        except KeyboardInterrupt:
+            pass
+        ser.write(b"CAPTURE OFF\n")
+        # Take the rest of the packets up to the reply
+        ser.timeout = 2.0
+        while True:
+            data = ser.read(max(1, ser.in_waiting))
+            if not data:
+                break
+            done = False
+            for kind, value in decoder.feed(data):
+                if kind == "samples":
+                    out.write("".join("%d\n" % v for v in value))
+                    count += len(value)
+                elif kind == "text" and value.startswith("CAPTURE"):
+                    done = True
+            if done:
+                break
+
+    print("%d samples, %d lost (%d packets lost, %d bad packets)" %
+          (count, decoder.lost_samples, decoder.lost_packets, decoder.bad_packets), file=sys.stderr)
+
+
+def read_segments(path):
+    """Read a recording as a list of (first sample index, samples lost just
+    before, samples), split at the "# gap" lines. Lost counts of -1 (not known)
+    are kept as such.
+    """
+    segments = []
+    start = 0
+    lost = 0
+    samples = []
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith("# gap"):
+                if samples:
+                    segments.append((start, lost, samples))
+                    start += len(samples)
+                    lost = 0
+                    samples = []
+                n = int(line.split()[2])
+                lost = -1 if n < 0 or lost < 0 else lost + n
+            elif line and not line.startswith("#"):
+                samples.append(int(line))
+    if samples:
+        segments.append((start, lost, samples))
+    return segments
+
+
+def replay_segment(ser, decoder, start, samples):
+    # Telemetry arrives between replies; one line per 10 ms task period
+    # keeps the samples going in at about the rate they were taken
+    for i in range(0, len(samples), SAMPLES_PER_LINE):
+        line = "S " + " ".join(str(v) for v in samples[i:i + SAMPLES_PER_LINE])
+        ser.write((line + "\n").encode("ascii"))
+        while True:
+            data = ser.read(max(1, ser.in_waiting))
+            if not data:
+                raise RuntimeError("Timed out during replay")
+            replied = False
+            for kind, value in decoder.feed(data):
+                if kind != "text":
+                    continue
+                if value.startswith("T "):
+                    print("%d,%s" % (start + i, value.split()[1]))
+                elif value == "OK":
+                    replied = True
+                else:
+                    raise RuntimeError("Replay: " + value)
+            if replied:
+                break
+
+
+def replay(ser, path):
+    decoder = Decoder()
+    segments = read_segments(path)
+    print("sample,rpm")
+    try:
+        command(ser, "SUB 100", decoder)
+        for start, lost, samples in segments:
+            if lost != 0:
+                print("gap of %s samples before sample %d, detector restarted" %
+                      (lost if lost > 0 else "unknown", start), file=sys.stderr)
+            # Starts the detector over, after the samples sent so far
+            reply = command(ser, "REPLAY ON", decoder)
+            if reply != "OK":
+                raise RuntimeError("REPLAY ON: " + reply)
+            replay_segment(ser, decoder, start, samples)
+    finally:
+        command(ser, "SUB 0", decoder)
+        command(ser, "REPLAY OFF", decoder)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("mode", choices=["record", "replay"])
+    parser.add_argument("file")
+    parser.add_argument("--port", default="/dev/ttyACM0", help="Serial port of the ST-Link VCP")
+    parser.add_argument("--baud", type=int, default=115200)
+    args = parser.parse_args()
+
+    import serial
+
+    with serial.Serial(args.port, args.baud, timeout=2.0) as ser:
+        if args.mode == "record":
+            record(ser, args.file)
+        else:
+            replay(ser, args.file)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
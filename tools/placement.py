@@ -0,0 +1,66 @@
+"""Report which memory each function and variable of the firmware landed in.
+
+Lists every symbol placed in RAM (CCM and SRAM), code first, i.e. what was
+marked HOT_CODE (see src/Placement.hpp), and the totals per memory, so that
+changes to the placement can be checked after a build. Flash symbols are only
+counted, unless --all is given.
+
+The memories argument is the MEMORIES table from the Makefile.
+"""
+
+import argparse
+import ast
+import subprocess
+import sys
+
+
+def read_symbols(elf, nm):
+    out = subprocess.run([nm, "--print-size", "--size-sort", "--demangle", elf],
+                         check=True, capture_output=True, text=True).stdout
+    symbols = []
+    for line in out.splitlines():
+        parts = line.split(maxsplit=3)
+        if len(parts) < 4:
+            continue
+        addr, size, kind, name = parts
+        symbols.append((int(addr, 16), int(size, 16), kind.lower(), name))
+    return symbols
+
+
+def find_memory(memories, addr):
+    for m in memories:
+        if m["start"] <= addr < m["start"] + m["size"]:
+            return m["name"]
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf")
+    parser.add_argument("memories", help="Memory table, as in the Makefile")
+    parser.add_argument("--nm", default="arm-none-eabi-nm")
+    parser.add_argument("--all", action="store_true", help="Also list flash symbols")
+    args = parser.parse_args()
+
+    memories = ast.literal_eval(args.memories)
+    placed = {m["name"]: [] for m in memories}
+    for addr, size, kind, name in read_symbols(args.elf, args.nm):
+        memory = find_memory(memories, addr)
+        if memory is not None:
+            placed[memory].append((addr, size, kind, name))
+
+    for m in memories:
+        symbols = placed[m["name"]]
+        used = sum(s[1] for s in symbols)
+        print("{}: {} of {} bytes in {} symbols".format(m["name"], used, m["size"], len(symbols)))
+        if "w" not in m["access"] and not args.all:
+            continue
+        # Code first, then data, largest first
+        symbols.sort(key=lambda s: (s[2] != "t", -s[1]))
+        for addr, size, kind, name in symbols:
+            print("  0x{:08x} {:6d} {} {}".format(addr, size, "code" if kind == "t" else "data", name))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,65 @@
+"""Send remote commands to the spin coater over the ST-Link virtual COM port.
+
+Each command is sent as one line, and the reply line is printed. Telemetry
+lines ("T <rpm> <setpoint>") arriving in between are skipped, except with
+--watch, which subscribes and prints them until interrupted.
+
+Requires pyserial. The port can be anything pyserial opens, including a
+pseudo-terminal, e.g. one end of a `socat -d -d pty,raw,echo=0 pty,raw,echo=0`
+pair for testing a controller script without the device.
+
+Examples:
+    remote.py SET 3000 START
+    remote.py "RECIPE CLEAR" "RECIPE ADD 500 5000" "RECIPE ADD 3000 30000" "RECIPE RUN"
+    remote.py --watch 100
+"""
+
+import argparse
+import sys
+
+
+def command(ser, line):
+    ser.write((line + "\n").encode("ascii"))
+    while True:
+        reply = ser.readline().decode("ascii", errors="replace").strip()
+        if not reply:
+            raise RuntimeError("Timed out waiting for a reply to " + line)
+        if not reply.startswith("T "):
+            return reply
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("commands", nargs="*", help="Commands, one per argument")
+    parser.add_argument("--port", default="/dev/ttyACM0", help="Serial port of the ST-Link VCP")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--timeout", type=float, default=2.0, help="Seconds to wait for a reply")
+    parser.add_argument("--watch", type=int, metavar="MS", help="Print telemetry every MS milliseconds")
+    args = parser.parse_args()
+
+    import serial
+
+    failed = False
+    with serial.Serial(args.port, args.baud, timeout=args.timeout) as ser:
+        for line in args.commands:
+            reply = command(ser, line)
+            print(line, "->", reply)
+            failed |= reply.startswith("ERR")
+
+        if args.watch:
+            command(ser, "SUB %d" % args.watch)
+            ser.timeout = None
+            try:
+                while True:
+                    line = ser.readline().decode("ascii", errors="replace").strip()
+                    if line.startswith("T "):
+                        print(line)
+            except KeyboardInterrupt:
+                ser.timeout = args.timeout
+                command(ser, "SUB 0")
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())